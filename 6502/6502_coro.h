@@ -0,0 +1,197 @@
+// Coroutine stepping API : run many guest machines on one host thread
+
+#ifndef CPU_6502_CORO_H
+#define CPU_6502_CORO_H
+
+#include <coroutine>
+#include <exception>
+#include <vector>
+#include "6502_cpu.h"
+
+namespace m6502{
+	struct Guest;
+	struct Executor;
+}
+
+// One emulated machine running as a coroutine. The frame is allocated once
+// when the guest is spawned; suspending and resuming it never allocates.
+struct m6502::Guest{
+	struct promise_type{
+		Executor* executor = nullptr;
+		u32 id = 0;
+		const IOWait* wait = nullptr;   // Device access the guest's CPU blocked on
+
+		Guest get_return_object(){
+			return Guest{ std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void(){}
+		void unhandled_exception(){ std::terminate(); }
+	};
+
+	using Handle = std::coroutine_handle<promise_type>;
+	Handle h;
+
+	explicit Guest(Handle handle) : h(handle){}
+	Guest(Guest&& other) noexcept : h(other.h){ other.h = nullptr; }
+	Guest(const Guest&) = delete;
+	Guest& operator=(const Guest&) = delete;
+	Guest& operator=(Guest&& other) noexcept{
+		if(this != &other){
+			if(h) h.destroy();
+			h = other.h;
+			other.h = nullptr;
+		}
+		return *this;
+	}
+
+	~Guest(){
+		if(h) h.destroy();
+	}
+};
+
+// Round-robin scheduler for guests. A guest runs for one cycle quantum, then
+// either goes to the back of the ready queue or, if it stopped on a device
+// access that was not ready, parks. Each runReady() call polls the device
+// every parked guest blocked on and requeues it as soon as that access can
+// go through.
+// Not thread safe. The host drives it from one thread in a loop : feed and
+// drain devices, call wake() for events outside any device, then
+// runReady(maxResumes) to run a bounded number of quanta and get control
+// back. runReady() without a bound only returns once no guest is runnable,
+// so it never returns while a guest keeps yielding.
+struct m6502::Executor{
+	std::vector<Guest> guests;
+	std::vector<u32> ready;         // Ring of guest ids, one slot per guest
+	std::vector<bool> queued;
+	u32 readyHead = 0;
+	u32 readyCount = 0;
+	std::vector<u32> parked;        // Reserved for every guest, so parking never allocates
+
+	// Suspend at the end of a quantum and go to the back of the ready queue
+	struct Yield{
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(Guest::Handle h) const noexcept {
+			h.promise().executor->enqueue(h.promise().id);
+		}
+		void await_resume() const noexcept {}
+	};
+
+	// Suspend until the device the guest blocked on is ready, or wake() is called
+	struct WaitIO{
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(Guest::Handle h) const noexcept {
+			h.promise().executor->parked.push_back(h.promise().id);
+		}
+		void await_resume() const noexcept {}
+	};
+
+	template<class Core>
+	static Guest run(Core& cpu, Mem& memory, u32 quantum){
+		s32 overshoot = 0;      // Cycles the previous quantum ran over, charged to the next
+
+		while(!cpu.halted){
+			overshoot = cpu.exec(quantum + overshoot, memory);
+			if(overshoot > 0)
+				overshoot = 0;
+
+			if(cpu.waitingIO)
+				co_await WaitIO{};
+			else
+				co_await Yield{};
+		}
+	}
+
+	// Create a guest for cpu/memory and queue it. cpu and memory must outlive the executor.
+	// Any BasicCPU variant can be spawned, so one executor can run a mixed batch.
+	template<class Core>
+	u32 spawn(Core& cpu, Mem& memory, u32 quantum){
+		u32 id = guests.size();
+		guests.push_back(run(cpu, memory, quantum));
+		guests.back().h.promise().executor = this;
+		guests.back().h.promise().id = id;
+		guests.back().h.promise().wait = &cpu.blockedOn;
+		parked.reserve(guests.size());
+
+		// Grow the ring, keeping queued ids in order
+		std::vector<u32> ring(guests.size());
+		for(u32 i=0; i<readyCount; i++){
+			ring[i] = ready[(readyHead + i) % ready.size()];
+		}
+		ready.swap(ring);
+		readyHead = 0;
+		queued.push_back(false);
+
+		enqueue(id);
+		return id;
+	}
+
+	void enqueue(u32 id){
+		if(queued[id])
+			return;
+
+		ready[(readyHead + readyCount) % ready.size()] = id;
+		readyCount++;
+		queued[id] = true;
+	}
+
+	// Requeue a guest regardless of what it is waiting on
+	void wake(u32 id){
+		if(!guests[id].h.done())
+			enqueue(id);
+	}
+
+	// Requeue parked guests whose device access can now complete
+	void pollParked(){
+		u32 kept = 0;
+
+		for(u32 id : parked){
+			if(queued[id])
+				continue;       // Already woken
+
+			if(guests[id].h.promise().wait->ready())
+				enqueue(id);
+			else
+				parked[kept++] = id;
+		}
+		parked.resize(kept);
+	}
+
+	// Resume at most maxResumes quanta, polling parked guests first and
+	// whenever the ready queue empties. Returns the number of quanta run;
+	// 0 means every guest is finished or parked on a device that is not ready.
+	u32 runReady(u32 maxResumes){
+		u32 resumed = 0;
+
+		pollParked();
+		while(resumed < maxResumes){
+			if(readyCount == 0){
+				pollParked();
+				if(readyCount == 0)
+					break;
+			}
+
+			u32 id = ready[readyHead];
+			readyHead = (readyHead + 1) % ready.size();
+			readyCount--;
+			queued[id] = false;
+
+			guests[id].h.resume();
+			resumed++;
+		}
+		return resumed;
+	}
+
+	// Resume guests until every guest is finished or parked on a device that is not ready
+	void runReady(){
+		while(runReady(guests.size()) > 0){}
+	}
+
+	bool done(u32 id) const{
+		return guests[id].h.done();
+	}
+};
+
+#endif
@@ -1,5 +1,9 @@
 // Datasheet : http://www.obelisk.me.uk/6502/
 
+#ifndef CPU_6502_H
+#define CPU_6502_H
+
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -14,12 +18,30 @@ namespace m6502{
 
 	using u32 = unsigned int;
 	using s32 = signed int;
+	using u64 = unsigned long long;
+
+	// Instruction set variant, fixed at compile time per engine
+	enum class Variant{
+		NMOS,               // Documented NMOS 6502 opcodes
+		NMOS_UNDOCUMENTED,  // NMOS plus the stable undocumented opcodes (LAX, SAX)
+		CMOS_65C02          // WDC/Rockwell 65C02 additions
+	};
 
-	struct CPU;
+	template<Variant V> struct BasicCPU;
+	using CPU = BasicCPU<Variant::NMOS>;
 	struct Mem;
     struct Flags;
+	struct IODevice;
+	struct IOWait;
+	struct CodeWatch;
+	struct StateSample;
+	struct StateSampler;
 }
 
+#ifdef M6502_PERF
+#include "6502_perf.h"
+#endif
+
 struct m6502::Flags{	
 	Byte C : 1;         //0: Carry Flag	
 	Byte Z : 1;         //1: Zero Flag
@@ -54,7 +76,75 @@ struct m6502::Mem{
 	}
 };
 
-struct m6502::CPU{
+// Memory-mapped device. CPU reads and writes in [base, base + size) go to the
+// device instead of Mem. Several devices can be chained through next.
+struct m6502::IODevice{
+	Word base = 0;
+	Word size = 0;
+	IODevice* next = nullptr;
+	bool volatileReads = true;  // Reads can change without a guest write; disables idle-loop skipping
+
+	bool maps(Word addr) const{
+		return static_cast<Word>(addr - base) < size;
+	}
+
+	// Set block when the access cannot complete yet. A blocked access must have
+	// no effect : the CPU rolls the instruction back and retries it on resume.
+	virtual Byte read(Word addr, bool& block) = 0;
+	virtual void write(Word addr, Byte value, bool& block) = 0;
+
+	// True once a blocked access to addr would now go through
+	virtual bool ready(Word addr, bool write){
+		return true;
+	}
+
+	virtual ~IODevice() = default;
+};
+
+// Told about guest writes to memory pages it marks in watched, so a cache of
+// decoded code can drop what the guest overwrote
+struct m6502::CodeWatch{
+	bool watched[256] = {};     // By address high byte
+
+	virtual ~CodeWatch() = default;
+	virtual void codeWritten(Word addr) = 0;
+};
+
+// The device access a CPU is waiting on after waitingIO was set
+struct m6502::IOWait{
+	IODevice* device = nullptr;
+	Word addr = 0;
+	bool write = false;
+
+	bool ready() const{
+		return !device || device->ready(addr, write);
+	}
+};
+
+// Register and progress counters at one point in time
+struct m6502::StateSample{
+	u64 hostNs;         // Host steady clock, filled in by the sampler
+	u64 cycles;         // Guest cycles elapsed
+	u64 instructions;   // Guest instructions retired
+	u64 idleCycles;     // Cycles credited by idle-loop skipping
+	Word PC;
+	Byte SP, A, X, Y, PS;
+};
+
+// Receives a StateSample every interval guest cycles (see 6502_telemetry.h).
+// Cycles skipped by idle-loop detection count, so idle guests keep reporting.
+// sample() runs on the emulation thread and must not block.
+struct m6502::StateSampler{
+	u32 interval = 1000000;
+
+	virtual void sample(const StateSample& state) = 0;
+	virtual ~StateSampler() = default;
+};
+
+template<m6502::Variant V>
+struct m6502::BasicCPU{
+    static constexpr Variant variant = V;
+
     Word PC;        // Program counter
 	Byte SP;        // Stack pointer
 
@@ -65,6 +155,30 @@ struct m6502::CPU{
 		Flags stflag;
 	};
 
+	bool halted = false;        // Set on an unhandled opcode, which PC is left at; cleared by reset()
+	bool waitingIO = false;     // Set when a device access is not ready; exec() returns before that instruction
+	IODevice* devices = nullptr;    // Memory-mapped devices, checked before Mem
+	Byte retryA, retryX, retryY, retryPS;   // Registers when a device access blocked
+	IOWait blockedOn;
+	CodeWatch* codeWatch = nullptr;
+
+#ifdef M6502_PERF
+	HostProfiler* profiler = nullptr;
+#endif
+
+	// Idle-loop detection : register state sampled at the last backward branch or jump
+	bool idleArmed = false;
+	bool loopSideEffects = false;   // Set by any memory write or device access since the last sample
+	Word idleLoopPC;
+	Byte idleA, idleX, idleY, idleSP, idlePS;
+	s32 idleCycles;
+	u64 idleCyclesSkipped = 0;      // Cycles credited without being emulated
+
+	u64 cyclesElapsed = 0;          // Updated when exec() returns
+	u64 instructionsRetired = 0;
+	StateSampler* sampler = nullptr;
+	u64 nextSampleAt = 0;           // Guest cycle count at which the next sample is due
+
     // Process status bits
 	static constexpr Byte
 		NegativeFlagBit = 0b10000000,
@@ -158,11 +272,50 @@ struct m6502::CPU{
 
         //BIT
 		INS_BIT_ZP = 0x24,
-		INS_BIT_ABS = 0x2C;
+		INS_BIT_ABS = 0x2C,
+
+		// Branches
+		INS_BCC = 0x90,
+		INS_BCS = 0xB0,
+		INS_BEQ = 0xF0,
+		INS_BMI = 0x30,
+		INS_BNE = 0xD0,
+		INS_BPL = 0x10,
+		INS_BVC = 0x50,
+		INS_BVS = 0x70,
+
+		// JMP
+		INS_JMP_ABS = 0x4C,
+
+		// 65C02 only
+		INS_LDA_INDZP = 0xB2,
+		INS_STA_INDZP = 0x92,
+		INS_AND_INDZP = 0x32,
+		INS_ORA_INDZP = 0x12,
+		INS_EOR_INDZP = 0x52,
+		INS_BIT_IM = 0x89,
+		INS_BIT_ZPX = 0x34,
+		INS_BIT_ABSX = 0x3C,
+		INS_STZ_ZP = 0x64,
+		INS_STZ_ZPX = 0x74,
+		INS_STZ_ABS = 0x9C,
+		INS_STZ_ABSX = 0x9E,
+		INS_BRA = 0x80,
+
+		// NMOS undocumented
+		INS_LAX_ZP = 0xA7,
+		INS_LAX_ZPY = 0xB7,
+		INS_LAX_ABS = 0xAF,
+		INS_LAX_ABSY = 0xBF,
+		INS_LAX_INDX = 0xA3,
+		INS_SAX_ZP = 0x87,
+		INS_SAX_ZPY = 0x97,
+		INS_SAX_ABS = 0x8F,
+		INS_SAX_INDX = 0x83;
 
 
     // Functions
-    Byte fetchByte(u32& cycles, Mem& memory){
+    Byte fetchByte(s32& cycles, Mem& memory){
         Byte data = memory[PC];
         PC++;
         cycles--;
@@ -170,7 +323,7 @@ struct m6502::CPU{
         return data;
     }
 
-    Word fetchWord(u32& cycles, Mem& memory){
+    Word fetchWord(s32& cycles, Mem& memory){
         Word data = memory[PC];
         PC++;
 
@@ -186,36 +339,153 @@ struct m6502::CPU{
         return data;
     }
 
-    Byte readByte(u32& cycles, Word addr, Mem& memory){
-        Byte data = memory[addr];
+    void blockOn(IODevice* dev, Word addr, bool write){
+        waitingIO = true;
+        blockedOn = IOWait{ dev, addr, write };
+        retryA = A;
+        retryX = X;
+        retryY = Y;
+        retryPS = PS;
+    }
+
+    IODevice* deviceAt(Word addr){
+        for(IODevice* dev = devices; dev; dev = dev->next){
+            if(dev->maps(addr))
+                return dev;
+        }
+        return nullptr;
+    }
+
+    // Plain memory is the inlined fast path; devices go through readDevice()
+    Byte readByte(s32& cycles, Word addr, Mem& memory){
         cycles--;
 
+        if(!devices)
+            return memory[addr];
+        return readDevice(addr, memory);
+    }
+
+    [[gnu::noinline, gnu::cold]]
+    Byte readDevice(Word addr, Mem& memory){
+        IODevice* dev = deviceAt(addr);
+        if(!dev)
+            return memory[addr];
+
+        bool block = false;
+        Byte data = dev->read(addr, block);
+        if(block)
+            blockOn(dev, addr, false);
+        loopSideEffects |= dev->volatileReads;
+
         return data;
     }
 
-    Byte readWord(u32& cycles, Word addr, Mem& memory){
+    Word readWord(s32& cycles, Word addr, Mem& memory){
         Byte loByte = readByte(cycles, addr, memory);
 		Byte hiByte = readByte(cycles, addr+1, memory);
 
 		return loByte | (hiByte << 8);
     }
 
-	void writeByte(Byte value, u32& cycles, Word addr, Mem& memory){
-		memory[addr] = value;
+    // Pointer stored in zero page; the high byte wraps from $FF to $00
+    Word readZeroPageWord(s32& cycles, Byte addr, Mem& memory){
+        Byte loByte = readByte(cycles, addr, memory);
+        Byte hiByte = readByte(cycles, static_cast<Byte>(addr + 1), memory);
+
+        return loByte | (hiByte << 8);
+    }
+
+	// Plain memory is the inlined fast path; devices and watched code pages go through writeSlow()
+	void writeByte(Byte value, s32& cycles, Word addr, Mem& memory){
+		loopSideEffects = true;
 		cycles--;
+
+		if(!devices && !(codeWatch && codeWatch->watched[addr >> 8]))
+			memory[addr] = value;
+		else
+			writeSlow(value, addr, memory);
+	}
+
+	[[gnu::noinline, gnu::cold]]
+	void writeSlow(Byte value, Word addr, Mem& memory){
+		IODevice* dev = devices ? deviceAt(addr) : nullptr;
+
+		if(dev){
+			bool block = false;
+			dev->write(addr, value, block);
+			if(block)
+				blockOn(dev, addr, true);
+		}
+		else{
+			memory[addr] = value;
+			if(codeWatch && codeWatch->watched[addr >> 8])
+				codeWatch->codeWritten(addr);
+		}
 	}
 
-	void writeWord(Word value, u32& cycles, Word addr, Mem& memory){
-		memory[addr] = value & 0xFF;
-		memory[addr + 1] = (value >> 8);
-		cycles -= 2;
+	void writeWord(Word value, s32& cycles, Word addr, Mem& memory){
+		writeByte(value & 0xFF, cycles, addr, memory);
+		writeByte(value >> 8, cycles, addr + 1, memory);
 	}
 
+    // Undo an instruction whose device access blocked. Registers are only
+    // written after an instruction's memory access, so the values saved when
+    // the access blocked are the ones the instruction started with.
+    void rollback(Word instrPC, s32 instrCycles, s32& cycles){
+        PC = instrPC;
+        A = retryA;
+        X = retryX;
+        Y = retryY;
+        PS = retryPS;
+        cycles = instrCycles;
+    }
+
     void setZeroAndNegativeFlags(Byte reg){
         stflag.Z = (reg==0);
         stflag.N = (reg & 0b10000000) > 0;
     }
 
+    // Called after a taken branch or jump back to PC. If the previous backward
+    // transfer also landed on PC with identical registers and nothing was written
+    // to memory in between, the loop is at a fixed point : every further
+    // iteration is identical, so whole iterations are credited without running them.
+    void checkIdleLoop(s32& cycles){
+        if(idleArmed && PC == idleLoopPC && !loopSideEffects &&
+           A == idleA && X == idleX && Y == idleY && SP == idleSP && PS == idlePS){
+            s32 period = idleCycles - cycles;
+
+            if(period > 0 && cycles > 0){
+                s32 skip = cycles - cycles % period;
+                cycles -= skip;
+                idleCyclesSkipped += skip;
+            }
+        }
+
+        idleArmed = true;
+        loopSideEffects = false;
+        idleLoopPC = PC;
+        idleA = A; idleX = X; idleY = Y; idleSP = SP; idlePS = PS;
+        idleCycles = cycles;
+    }
+
+    // 2 cycles, +1 when taken, +1 more when the target is on another page
+    void branchIf(bool condition, Word instrPC, s32& cycles, Mem& memory){
+        signed char offset = static_cast<signed char>(fetchByte(cycles, memory));
+
+        if(condition){
+            Word target = PC + offset;
+            cycles--;
+
+            const bool pageBoundaryCrossed = (PC ^ target) >> 8;
+            if(pageBoundaryCrossed)
+                cycles--;
+
+            PC = target;
+            if(target <= instrPC)
+                checkIdleLoop(cycles);
+        }
+    }
+
     void printStatus(){
         printf("--------------------------------------\n");
         printf( "A: 0x%02x  X: 0x%02x  Y: 0x%02x\n", A, X, Y );
@@ -233,6 +503,10 @@ struct m6502::CPU{
         SP = 0x00FF;
         stflag.C = stflag.Z = stflag.I = stflag.D = stflag.B = stflag.V = stflag.N = 0;
         A = X = Y = 0;
+        halted = waitingIO = false;
+        idleCyclesSkipped = 0;
+        cyclesElapsed = instructionsRetired = 0;
+        nextSampleAt = 0;
         memory.initialise();
 	}
 
@@ -266,8 +540,232 @@ struct m6502::CPU{
         }
     }
 
-    void exec(u32 cycles, Mem& memory){
+    // Addressing helpers for the variant opcodes below
+    Word addrZeroPageIndexed(Byte index, s32& cycles, Mem& memory){
+        Byte zeroPageAddr = fetchByte(cycles, memory);
+        zeroPageAddr += index;
+        cycles--;
+        return zeroPageAddr;
+    }
+
+    Word addrAbsoluteIndexed(Byte index, s32& cycles, Mem& memory){
+        Word absAddr = fetchWord(cycles, memory);
+        Word absAddrIndexed = absAddr + index;
+
+        const bool pageBoundaryCrossed = (absAddr ^ absAddrIndexed) >> 8;
+        if(pageBoundaryCrossed)
+            cycles--;
+
+        return absAddrIndexed;
+    }
+
+    Word addrIndexedIndirect(s32& cycles, Mem& memory){
+        Byte zeroPageAddr = fetchByte(cycles, memory);
+        zeroPageAddr += X;
+        cycles--;
+        return readZeroPageWord(cycles, zeroPageAddr, memory);
+    }
+
+    Word addrZeroPageIndirect(s32& cycles, Mem& memory){
+        Byte zeroPageAddr = fetchByte(cycles, memory);
+        return readZeroPageWord(cycles, zeroPageAddr, memory);
+    }
+
+    void loadAX(Byte value){
+        A = X = value;
+        setZeroAndNegativeFlags(A);
+    }
+
+    // Opcodes that only exist in some variants. Reached from the default case
+    // of exec(), and compiled out entirely for plain NMOS, so the shared
+    // opcodes dispatch through the same switch in every variant.
+    // Returns false when the opcode is not part of this variant.
+    bool execVariant(Byte instr, Word instrPC, s32& cycles, Mem& memory){
+        if constexpr(V == Variant::CMOS_65C02){
+            switch(instr){
+                case INS_LDA_INDZP:{
+                    A = readByte(cycles, addrZeroPageIndirect(cycles, memory), memory);
+                    setZeroAndNegativeFlags(A);
+                } break;
+
+                case INS_STA_INDZP:{
+                    writeByte(A, cycles, addrZeroPageIndirect(cycles, memory), memory);
+                } break;
+
+                case INS_AND_INDZP:{
+                    A &= readByte(cycles, addrZeroPageIndirect(cycles, memory), memory);
+                    setZeroAndNegativeFlags(A);
+                } break;
+
+                case INS_ORA_INDZP:{
+                    A |= readByte(cycles, addrZeroPageIndirect(cycles, memory), memory);
+                    setZeroAndNegativeFlags(A);
+                } break;
+
+                case INS_EOR_INDZP:{
+                    A ^= readByte(cycles, addrZeroPageIndirect(cycles, memory), memory);
+                    setZeroAndNegativeFlags(A);
+                } break;
+
+                // Immediate BIT only affects Z
+                case INS_BIT_IM:{
+                    stflag.Z = !(A & fetchByte(cycles, memory));
+                } break;
+
+                case INS_BIT_ZPX:
+                case INS_BIT_ABSX:{
+                    Word addr = (instr == INS_BIT_ZPX) ? addrZeroPageIndexed(X, cycles, memory)
+                                                       : addrAbsoluteIndexed(X, cycles, memory);
+                    Byte value = readByte(cycles, addr, memory);
+
+                    stflag.Z = !(A & value);
+                    stflag.N = (value & NegativeFlagBit) != 0;
+                    stflag.V = (value & OverflowFlagBit) != 0;
+                } break;
+
+                case INS_STZ_ZP:{
+                    writeByte(0, cycles, fetchByte(cycles, memory), memory);
+                } break;
+
+                case INS_STZ_ZPX:{
+                    writeByte(0, cycles, addrZeroPageIndexed(X, cycles, memory), memory);
+                } break;
+
+                case INS_STZ_ABS:{
+                    writeByte(0, cycles, fetchWord(cycles, memory), memory);
+                } break;
+
+                // Always 5 cycles
+                case INS_STZ_ABSX:{
+                    Word absAddr = fetchWord(cycles, memory);
+                    cycles--;
+                    writeByte(0, cycles, absAddr + X, memory);
+                } break;
+
+                case INS_BRA: branchIf(true, instrPC, cycles, memory); break;
+
+                default:
+                    return false;
+            }
+            return true;
+        }
+        else if constexpr(V == Variant::NMOS_UNDOCUMENTED){
+            switch(instr){
+                case INS_LAX_ZP:{
+                    loadAX(readByte(cycles, fetchByte(cycles, memory), memory));
+                } break;
+
+                case INS_LAX_ZPY:{
+                    loadAX(readByte(cycles, addrZeroPageIndexed(Y, cycles, memory), memory));
+                } break;
+
+                case INS_LAX_ABS:{
+                    loadAX(readByte(cycles, fetchWord(cycles, memory), memory));
+                } break;
+
+                case INS_LAX_ABSY:{
+                    loadAX(readByte(cycles, addrAbsoluteIndexed(Y, cycles, memory), memory));
+                } break;
+
+                case INS_LAX_INDX:{
+                    loadAX(readByte(cycles, addrIndexedIndirect(cycles, memory), memory));
+                } break;
+
+                // A AND X stored, no flags affected
+                case INS_SAX_ZP:{
+                    writeByte(A & X, cycles, fetchByte(cycles, memory), memory);
+                } break;
+
+                case INS_SAX_ZPY:{
+                    writeByte(A & X, cycles, addrZeroPageIndexed(Y, cycles, memory), memory);
+                } break;
+
+                case INS_SAX_ABS:{
+                    writeByte(A & X, cycles, fetchWord(cycles, memory), memory);
+                } break;
+
+                case INS_SAX_INDX:{
+                    writeByte(A & X, cycles, addrIndexedIndirect(cycles, memory), memory);
+                } break;
+
+                default:
+                    return false;
+            }
+            return true;
+        }
+        else{
+            return false;
+        }
+    }
+
+    void sampleState(u64 cycles){
+        nextSampleAt = cycles + sampler->interval;
+
+        StateSample state{};
+        state.hostNs = 0;
+        state.cycles = cycles;
+        state.instructions = instructionsRetired;
+        state.idleCycles = idleCyclesSkipped;
+        state.PC = PC;
+        state.SP = SP;
+        state.A = A;
+        state.X = X;
+        state.Y = Y;
+        state.PS = PS;
+        sampler->sample(state);
+    }
+
+    // Remaining slice cycles at or below which the next sample is due, so the
+    // dispatch loop compares a register instead of counting down per instruction.
+    // budget is the cycle count the slice started from.
+    s32 sampleThreshold(s32 budget) const{
+        if(!sampler)
+            return INT32_MIN;
+
+        long long threshold = budget + static_cast<long long>(cyclesElapsed) - static_cast<long long>(nextSampleAt);
+        return threshold < INT32_MIN ? INT32_MIN : threshold > INT32_MAX ? INT32_MAX : static_cast<s32>(threshold);
+    }
+
+    // Returns the cycles left over : zero or negative when the last instruction
+    // ran past the budget, positive when a device blocked or the CPU halted.
+    // Callers running back-to-back slices add a negative result to the next budget.
+    // A halted CPU does nothing and returns the whole budget.
+    s32 exec(s32 cycles, Mem& memory){
+        if(halted)
+            return cycles;
+
+        const s32 budget = cycles;
+        waitingIO = false;
+        idleArmed = false;
+
+        cycles = run<false>(cycles, budget, memory);
+#ifdef M6502_PERF
+        if(profiler)
+            profiler->pause();
+#endif
+
+        cyclesElapsed += budget - cycles;
+        return cycles;
+    }
+
+    // Decode and execute instructions until the budget runs out or a device
+    // blocks; with Single, just one. budget is the cycle count the caller
+    // started from, used for sample timestamps. Both instantiations keep the
+    // switch in their own loop so exec() dispatches without a call per instruction.
+    // cycles is taken and returned by value so it can live in a register.
+    template<bool Single>
+    s32 run(s32 cycles, s32 budget, Mem& memory){
+        u64 retired = 0;        // Added to instructionsRetired on the way out, not per instruction
+        s32 sampleBelow = sampleThreshold(budget);
+
         while(cycles > 0){
+#ifdef M6502_PERF
+            s32 startCycles = cycles;
+            if(profiler)
+                profiler->begin(PC);
+#endif
+            const s32 instrCycles = cycles;
+            Word instrPC = PC;
             Byte instr = fetchByte(cycles, memory);     // Read instruction opcode
 
             switch(instr){
@@ -328,7 +826,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += X;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     A = readByte(cycles, effectiveAddr, memory);
                     setZeroAndNegativeFlags(A);
@@ -338,7 +836,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += Y;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     A = readByte(cycles, effectiveAddr, memory);
                     setZeroAndNegativeFlags(A);
@@ -474,7 +972,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += X;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     writeByte(A, cycles, effectiveAddr, memory);
                 } break;
@@ -483,7 +981,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += Y;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     writeByte(A, cycles, effectiveAddr, memory);
                 } break;
@@ -611,7 +1109,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += X;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     A &= readByte(cycles, effectiveAddr, memory);
                     setZeroAndNegativeFlags(A);
@@ -621,7 +1119,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += Y;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     A &= readByte(cycles, effectiveAddr, memory);
                     setZeroAndNegativeFlags(A);
@@ -685,7 +1183,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += X;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     A |= readByte(cycles, effectiveAddr, memory);
                     setZeroAndNegativeFlags(A);
@@ -695,7 +1193,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += Y;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     A |= readByte(cycles, effectiveAddr, memory);
                     setZeroAndNegativeFlags(A);
@@ -759,7 +1257,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += X;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     A ^= readByte(cycles, effectiveAddr, memory);
                     setZeroAndNegativeFlags(A);
@@ -769,7 +1267,7 @@ struct m6502::CPU{
                     Byte zeroPageAddr = fetchByte(cycles, memory);
                     zeroPageAddr += Y;
                     cycles--;
-                    Word effectiveAddr = readWord(cycles, zeroPageAddr, memory);
+                    Word effectiveAddr = readZeroPageWord(cycles, zeroPageAddr, memory);
 
                     A ^= readByte(cycles, effectiveAddr, memory);
                     setZeroAndNegativeFlags(A);
@@ -795,12 +1293,62 @@ struct m6502::CPU{
                 } break;
 
 
+                case INS_BCC: branchIf(!stflag.C, instrPC, cycles, memory); break;
+                case INS_BCS: branchIf(stflag.C, instrPC, cycles, memory); break;
+                case INS_BEQ: branchIf(stflag.Z, instrPC, cycles, memory); break;
+                case INS_BMI: branchIf(stflag.N, instrPC, cycles, memory); break;
+                case INS_BNE: branchIf(!stflag.Z, instrPC, cycles, memory); break;
+                case INS_BPL: branchIf(!stflag.N, instrPC, cycles, memory); break;
+                case INS_BVC: branchIf(!stflag.V, instrPC, cycles, memory); break;
+                case INS_BVS: branchIf(stflag.V, instrPC, cycles, memory); break;
+
+
+                case INS_JMP_ABS:{
+                    PC = fetchWord(cycles, memory);
+                    if(PC <= instrPC)
+                        checkIdleLoop(cycles);
+                } break;
+
+
                 default:{
-                    cout << "Unhandled instruction\n";
-                    cycles = 0;
+                    if(!execVariant(instr, instrPC, cycles, memory)){
+                        // Stop before the opcode without charging it
+                        cout << "Unhandled instruction\n";
+                        halted = true;
+                        PC = instrPC;
+                        instructionsRetired += retired;
+                        return instrCycles;
+                    }
                 } break;
             }
+
+            // The blocked access did not happen; undo the instruction so it is retried on resume
+            if(waitingIO){
+                rollback(instrPC, instrCycles, cycles);
+                break;
+            }
+
+#ifdef M6502_PERF
+            if(profiler)
+                profiler->end(instrPC, instr, startCycles - cycles, PC);
+#endif
+
+            retired++;
+            if(cycles <= sampleBelow){
+                instructionsRetired += retired;
+                retired = 0;
+                sampleState(cyclesElapsed + (budget - cycles));
+                sampleBelow = sampleThreshold(budget);
+            }
+
+            if constexpr(Single)
+                break;
         }
+
+        instructionsRetired += retired;
+        return cycles;
     }
 
 };
+
+#endif
@@ -0,0 +1,356 @@
+// Host hardware performance counters per guest opcode and PC region
+// Included by 6502_cpu.h when built with -DM6502_PERF (see the perf target in the Makefile)
+
+#ifndef CPU_6502_PERF_H
+#define CPU_6502_PERF_H
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace m6502{
+	struct HostProfiler;
+}
+
+// Counts user-space host events while CPU::exec runs guest code. When the
+// kernel lets user space read the counters with rdpmc, they are read around
+// every guest instruction and charged to its opcode. Otherwise each read is a
+// syscall, which would swamp a single instruction, so the counters are only
+// read at guest control-flow boundaries and charged to the basic block that
+// ended there; opcodes then get the guest-level profile only.
+// Block and per-instruction samples are also charged to any registered PC
+// region. Counters the kernel refuses (unprivileged, virtualised, missing
+// PMU) are skipped. The cost of reading the counters is measured once and
+// subtracted from every sample.
+struct m6502::HostProfiler{
+	enum Counter{ HOST_CYCLES, HOST_INSTRUCTIONS, BRANCH_MISSES, CACHE_MISSES, NUM_COUNTERS };
+
+	struct Bin{
+		u64 executed = 0;       // Guest instructions
+		u64 guestCycles = 0;
+		u64 host[NUM_COUNTERS] = {};
+	};
+
+	struct Region{
+		Word lo, hi;            // Inclusive PC range
+		std::string name;
+		Bin bin;
+	};
+
+	int leader = -1;
+	int fds[NUM_COUNTERS];
+	int slot[NUM_COUNTERS];     // Position in the group read, -1 when unavailable
+	perf_event_mmap_page* pages[NUM_COUNTERS];  // For rdpmc, nullptr when not mapped
+	u32 numOpen = 0;
+	bool userRead = false;      // Every open counter can be read with rdpmc
+
+	u64 last[NUM_COUNTERS] = {};
+	u64 overhead[NUM_COUNTERS] = {};
+
+	bool blockOpen = false;     // Counters were read at the start of blockPC
+	Word blockPC = 0;
+	Bin block;                  // Guest counts of the open block
+
+	Bin opcodes[256];
+	std::unordered_map<Word, Bin> blocks;     // By block start PC, without rdpmc
+	std::vector<Region> regions;
+
+	HostProfiler(){
+		static constexpr u64 config[NUM_COUNTERS] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_BRANCH_MISSES,
+			PERF_COUNT_HW_CACHE_MISSES
+		};
+
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			fds[i] = -1;
+			slot[i] = -1;
+			pages[i] = nullptr;
+
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = config[i];
+			attr.disabled = (leader < 0);
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+
+			int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+			if(fd < 0)
+				continue;
+
+			if(leader < 0)
+				leader = fd;
+			fds[i] = fd;
+			slot[i] = numOpen++;
+		}
+
+		if(leader >= 0){
+			ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+			mapUserPages();
+			calibrate();
+		}
+	}
+
+	~HostProfiler(){
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			if(pages[i])
+				munmap(pages[i], sysconf(_SC_PAGESIZE));
+			if(fds[i] >= 0)
+				close(fds[i]);
+		}
+	}
+
+	HostProfiler(const HostProfiler&) = delete;
+	HostProfiler& operator=(const HostProfiler&) = delete;
+
+	void addRegion(Word lo, Word hi, const std::string& name){
+		regions.push_back(Region{ lo, hi, name, Bin{} });
+	}
+
+	// Map each counter's control page and check that user space may rdpmc it
+	void mapUserPages(){
+#if defined(__x86_64__) || defined(__i386__)
+		userRead = true;
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			if(fds[i] < 0)
+				continue;
+
+			void* page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fds[i], 0);
+			if(page == MAP_FAILED){
+				userRead = false;
+				continue;
+			}
+
+			pages[i] = static_cast<perf_event_mmap_page*>(page);
+			if(!pages[i]->cap_user_rdpmc)
+				userRead = false;
+		}
+#endif
+	}
+
+	// Read one counter without a syscall. Fails when the kernel has the
+	// counter descheduled (index 0), in which case only read() can see it.
+	static bool readUser(const perf_event_mmap_page* page, u64& out){
+#if defined(__x86_64__) || defined(__i386__)
+		u32 seq;
+		do{
+			seq = page->lock;
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+			u32 index = page->index;
+			if(!page->cap_user_rdpmc || index == 0)
+				return false;
+
+			u32 lo, hi;
+			asm volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(index - 1));
+
+			// Sign-extend the pmc_width-bit hardware value before adding the kernel's offset
+			u32 shift = 64 - page->pmc_width;
+			long long pmc = static_cast<long long>((static_cast<u64>(hi) << 32 | lo) << shift) >> shift;
+			out = page->offset + pmc;
+
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		} while(page->lock != seq);
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void readCounters(u64 (&out)[NUM_COUNTERS]){
+		if(userRead){
+			u64 values[NUM_COUNTERS];
+			bool ok = true;
+
+			for(u32 i=0; i<NUM_COUNTERS && ok; i++){
+				values[i] = 0;
+				if(pages[i])
+					ok = readUser(pages[i], values[i]);
+			}
+
+			if(ok){
+				for(u32 i=0; i<NUM_COUNTERS; i++){
+					out[i] = values[i];
+				}
+				return;
+			}
+		}
+
+		u64 buf[1 + NUM_COUNTERS];
+		if(leader < 0 || read(leader, buf, sizeof(buf)) < static_cast<ssize_t>(sizeof(u64) * (1 + numOpen)))
+			return;
+
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			out[i] = (slot[i] >= 0) ? buf[1 + slot[i]] : 0;
+		}
+	}
+
+	// Smallest cost of an empty begin()/end() pair over a few tries
+	void calibrate(){
+		static constexpr u32 TRIES = 64;
+		u64 best[NUM_COUNTERS];
+		u64 now[NUM_COUNTERS];
+
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			best[i] = ~0ULL;
+		}
+
+		for(u32 t=0; t<TRIES; t++){
+			readCounters(last);
+			readCounters(now);
+			for(u32 i=0; i<NUM_COUNTERS; i++){
+				u64 delta = now[i] - last[i];
+				if(delta < best[i])
+					best[i] = delta;
+			}
+		}
+
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			overhead[i] = best[i];
+		}
+	}
+
+	// Before the instruction at pc
+	void begin(Word pc){
+		if(userRead){
+			readCounters(last);
+		}
+		else if(!blockOpen){
+			blockOpen = true;
+			blockPC = pc;
+			readCounters(last);
+		}
+	}
+
+	// After the instruction at pc retired; nextPC is where the guest continues
+	void end(Word pc, Byte opcode, u32 guestCycles, Word nextPC){
+		if(userRead){
+			u64 delta[NUM_COUNTERS];
+			sample(delta);
+
+			charge(opcodes[opcode], 1, guestCycles, delta);
+			chargeRegions(pc, 1, guestCycles, delta);
+			return;
+		}
+
+		static constexpr u64 NONE[NUM_COUNTERS] = {};
+		charge(opcodes[opcode], 1, guestCycles, NONE);
+		block.executed++;
+		block.guestCycles += guestCycles;
+
+		// Anything but a fall through to the next instruction ends the block
+		if(static_cast<Word>(nextPC - pc - 1) >= 3)
+			pause();
+	}
+
+	// Close the open block, e.g. before the host does its own work between exec() calls
+	void pause(){
+		if(!blockOpen)
+			return;
+
+		u64 delta[NUM_COUNTERS];
+		sample(delta);
+
+		charge(blocks[blockPC], block.executed, block.guestCycles, delta);
+		chargeRegions(blockPC, block.executed, block.guestCycles, delta);
+		block = Bin{};
+		blockOpen = false;
+	}
+
+	// Counter deltas since last, less the cost of reading them
+	void sample(u64 (&delta)[NUM_COUNTERS]){
+		u64 now[NUM_COUNTERS];
+		readCounters(now);
+
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			u64 d = now[i] - last[i];
+			delta[i] = d > overhead[i] ? d - overhead[i] : 0;
+		}
+	}
+
+	void chargeRegions(Word pc, u64 executed, u64 guestCycles, const u64 (&delta)[NUM_COUNTERS]){
+		for(Region& region : regions){
+			if(pc >= region.lo && pc <= region.hi)
+				charge(region.bin, executed, guestCycles, delta);
+		}
+	}
+
+	static void charge(Bin& bin, u64 executed, u64 guestCycles, const u64 (&delta)[NUM_COUNTERS]){
+		bin.executed += executed;
+		bin.guestCycles += guestCycles;
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			bin.host[i] += delta[i];
+		}
+	}
+
+	void printRow(FILE* out, const char* label, const Bin& bin, bool hostCounts = true) const{
+		double n = static_cast<double>(bin.executed);
+		fprintf(out, "%-12s %10llu %8.2f", label, bin.executed, bin.guestCycles / n);
+
+		for(u32 i=0; i<NUM_COUNTERS; i++){
+			if(hostCounts && slot[i] >= 0)
+				fprintf(out, " %10.2f", bin.host[i] / n);
+			else
+				fprintf(out, " %10s", "-");
+		}
+		fprintf(out, "\n");
+	}
+
+	// Guest counts and cycles next to average host events per guest instruction.
+	// Without rdpmc, host events are listed for the hottest blocks instead of opcodes.
+	void report(FILE* out = stdout, u32 maxBlocks = 16) const{
+		if(numOpen == 0)
+			fprintf(out, "No host counters available, guest profile only\n");
+		else if(!userRead)
+			fprintf(out, "No user-space counter reads, host events per block only\n");
+
+		fprintf(out, "%-12s %10s %8s %10s %10s %10s %10s\n",
+			"opcode", "executed", "g.cyc", "h.cycles", "h.instrs", "br.miss", "cache.miss");
+
+		char label[16];
+		for(u32 op=0; op<256; op++){
+			if(opcodes[op].executed == 0)
+				continue;
+
+			snprintf(label, sizeof(label), "0x%02x", op);
+			printRow(out, label, opcodes[op], userRead);
+		}
+
+		std::vector<std::pair<Word, const Bin*>> hottest;
+		for(const auto& [pc, bin] : blocks){
+			hottest.emplace_back(pc, &bin);
+		}
+		std::sort(hottest.begin(), hottest.end(), [](const auto& a, const auto& b){
+			return a.second->host[HOST_CYCLES] != b.second->host[HOST_CYCLES]
+				? a.second->host[HOST_CYCLES] > b.second->host[HOST_CYCLES]
+				: a.second->executed > b.second->executed;
+		});
+		if(hottest.size() > maxBlocks)
+			hottest.resize(maxBlocks);
+
+		for(const auto& [pc, bin] : hottest){
+			snprintf(label, sizeof(label), "blk $%04x", pc);
+			printRow(out, label, *bin);
+		}
+
+		for(const Region& region : regions){
+			if(region.bin.executed > 0)
+				printRow(out, region.name.c_str(), region.bin);
+		}
+	}
+};
+
+#endif
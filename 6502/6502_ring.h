@@ -0,0 +1,94 @@
+// Lock-free single-producer/single-consumer ring
+
+#ifndef CPU_6502_RING_H
+#define CPU_6502_RING_H
+
+#include <atomic>
+#include "6502_cpu.h"
+
+namespace m6502{
+	template<typename T, u32 Capacity> struct SpscRing;
+}
+
+// Exactly one thread may push/writeSpan and exactly one other thread may
+// pop/readSpan. Each side keeps a cached copy of the other side's index so
+// the shared cache line is only touched when the cached view runs out.
+template<typename T, m6502::u32 Capacity>
+struct m6502::SpscRing{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+	static constexpr u32 MASK = Capacity - 1;
+
+	alignas(64) std::atomic<u32> head{0};   // Next slot to read, owned by the consumer
+	u32 cachedTail = 0;
+	alignas(64) std::atomic<u32> tail{0};   // Next slot to write, owned by the producer
+	u32 cachedHead = 0;
+	alignas(64) T slots[Capacity];
+
+	// Producer : contiguous free slots starting at the write position
+	T* writeSpan(u32& count){
+		u32 t = tail.load(std::memory_order_relaxed);
+		if(t - cachedHead == Capacity)
+			cachedHead = head.load(std::memory_order_acquire);
+
+		u32 free = Capacity - (t - cachedHead);
+		u32 toEnd = Capacity - (t & MASK);
+		count = free < toEnd ? free : toEnd;
+		return &slots[t & MASK];
+	}
+
+	void commitWrite(u32 count){
+		tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	// Consumer : contiguous filled slots starting at the read position
+	const T* readSpan(u32& count){
+		u32 h = head.load(std::memory_order_relaxed);
+		if(cachedTail == h)
+			cachedTail = tail.load(std::memory_order_acquire);
+
+		u32 used = cachedTail - h;
+		u32 toEnd = Capacity - (h & MASK);
+		count = used < toEnd ? used : toEnd;
+		return &slots[h & MASK];
+	}
+
+	void commitRead(u32 count){
+		head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	bool push(const T& value){
+		u32 count;
+		T* slot = writeSpan(count);
+		if(count == 0)
+			return false;
+
+		*slot = value;
+		commitWrite(1);
+		return true;
+	}
+
+	bool pop(T& value){
+		u32 count;
+		const T* slot = readSpan(count);
+		if(count == 0)
+			return false;
+
+		value = *slot;
+		commitRead(1);
+		return true;
+	}
+
+	// Consumer side estimate of queued items
+	u32 readable(){
+		cachedTail = tail.load(std::memory_order_acquire);
+		return cachedTail - head.load(std::memory_order_relaxed);
+	}
+
+	// Producer side estimate of free slots
+	u32 writable(){
+		cachedHead = head.load(std::memory_order_acquire);
+		return Capacity - (tail.load(std::memory_order_relaxed) - cachedHead);
+	}
+};
+
+#endif
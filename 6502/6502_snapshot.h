@@ -0,0 +1,230 @@
+// Content-addressed page store : deduplicated snapshots of CPU and Mem state
+
+#ifndef CPU_6502_SNAPSHOT_H
+#define CPU_6502_SNAPSHOT_H
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "6502_cpu.h"
+
+namespace m6502{
+	struct PageStore;
+}
+
+// Every 256-byte page of a snapshot is hashed and stored once in an
+// append-only, mmap'd pack file (<path>). A snapshot is its registers plus
+// one pack index per page, appended as a fixed-size record to <path>.idx.
+// Pages shared between snapshots (ROM, cleared RAM, tables) cost 4 bytes each
+// after the first copy, and restoring copies straight out of the mapping.
+// Each record also holds the pack page count once it was written, so a store
+// reopened after a crash ignores a partial trailing record and the unused,
+// zero-filled tail of the pack.
+struct m6502::PageStore{
+	static constexpr u32 PAGE_SIZE = 256;
+	static constexpr u32 PAGES_PER_MEM = Mem::MAX_MEM / PAGE_SIZE;
+
+	struct Snapshot{
+		Word PC;
+		Byte SP, A, X, Y, PS;
+		u32 packPages;          // Pages in the pack after this snapshot was saved
+		u32 pages[PAGES_PER_MEM];
+	};
+
+	int packFd = -1;
+	int indexFd = -1;
+	Byte* pack = nullptr;
+	u64 capacityPages = 0;
+	u32 numPages = 0;
+	u32 numSnapshots = 0;
+	bool opened = false;        // open() succeeded, so numPages describes the pack
+
+	std::unordered_multimap<u64, u32> pageIndex;   // Page hash -> pack index
+
+	PageStore() = default;
+	PageStore(const PageStore&) = delete;
+	PageStore& operator=(const PageStore&) = delete;
+
+	~PageStore(){
+		close();
+	}
+
+	static u64 hashPage(const Byte* page){
+		u64 h = 0xCBF29CE484222325ULL;
+
+		for(u32 i=0; i<PAGE_SIZE; i+=8){
+			u64 word;
+			memcpy(&word, page + i, 8);
+			h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+			h ^= h >> 29;
+		}
+		return h;
+	}
+
+	// Open or create the store, re-indexing pages already in the pack
+	bool open(const std::string& path){
+		close();
+
+		packFd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		indexFd = ::open((path + ".idx").c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+		if(packFd < 0 || indexFd < 0){
+			close();
+			return false;
+		}
+
+		struct stat st;
+		fstat(indexFd, &st);
+		numSnapshots = st.st_size / sizeof(Snapshot);
+
+		// Drop a record cut short by a crash so appends stay aligned
+		if(ftruncate(indexFd, static_cast<off_t>(numSnapshots) * sizeof(Snapshot)) != 0){
+			close();
+			return false;
+		}
+
+		// Pages past the last saved snapshot are unreferenced
+		fstat(packFd, &st);
+		numPages = 0;
+		if(numSnapshots > 0){
+			Snapshot last;
+			if(pread(indexFd, &last, sizeof(last), static_cast<off_t>(numSnapshots - 1) * sizeof(last)) != static_cast<ssize_t>(sizeof(last))){
+				close();
+				return false;
+			}
+			numPages = std::min<u64>(last.packPages, st.st_size / PAGE_SIZE);
+		}
+
+		if(!reserve(numPages > 0 ? numPages : 1024)){
+			close();
+			return false;
+		}
+
+		for(u32 i=0; i<numPages; i++){
+			pageIndex.emplace(hashPage(pagePtr(i)), i);
+		}
+		opened = true;
+		return true;
+	}
+
+	void close(){
+		if(pack){
+			munmap(pack, capacityPages * PAGE_SIZE);
+			pack = nullptr;
+		}
+		if(packFd >= 0){
+			// Drop the unused tail of the mapping so the page count survives reopening.
+			// A failed open() never read the page count, so it leaves the pack alone.
+			if(opened && ftruncate(packFd, static_cast<off_t>(numPages) * PAGE_SIZE) != 0)
+				cout << "PageStore : could not trim pack file\n";
+			::close(packFd);
+			packFd = -1;
+		}
+		if(indexFd >= 0){
+			::close(indexFd);
+			indexFd = -1;
+		}
+		pageIndex.clear();
+		capacityPages = numPages = numSnapshots = 0;
+		opened = false;
+	}
+
+	// Grow the file and mapping geometrically so appends stay amortised O(1)
+	bool reserve(u64 pages){
+		if(pages <= capacityPages)
+			return true;
+
+		u64 newCapacity = capacityPages ? capacityPages : 1024;
+		while(newCapacity < pages){
+			newCapacity *= 2;
+		}
+
+		if(ftruncate(packFd, newCapacity * PAGE_SIZE) != 0)
+			return false;
+
+		void* mapped = pack ? mremap(pack, capacityPages * PAGE_SIZE, newCapacity * PAGE_SIZE, MREMAP_MAYMOVE)
+		                    : mmap(nullptr, newCapacity * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, packFd, 0);
+		if(mapped == MAP_FAILED)
+			return false;
+
+		pack = static_cast<Byte*>(mapped);
+		capacityPages = newCapacity;
+		return true;
+	}
+
+	const Byte* pagePtr(u32 index) const{
+		return pack + static_cast<u64>(index) * PAGE_SIZE;
+	}
+
+	// Pack index of page, appending it if no identical page is stored yet
+	bool internPage(const Byte* page, u32& index){
+		u64 h = hashPage(page);
+
+		auto range = pageIndex.equal_range(h);
+		for(auto it = range.first; it != range.second; ++it){
+			if(memcmp(pagePtr(it->second), page, PAGE_SIZE) == 0){
+				index = it->second;
+				return true;
+			}
+		}
+
+		if(!reserve(numPages + 1))
+			return false;
+
+		index = numPages++;
+		memcpy(pack + static_cast<u64>(index) * PAGE_SIZE, page, PAGE_SIZE);
+		pageIndex.emplace(h, index);
+		return true;
+	}
+
+	// Store cpu/memory and return the snapshot id, or -1 on an I/O error
+	template<class Core>
+	s32 save(const Core& cpu, const Mem& memory){
+		Snapshot snap{};        // Zeroed so padding bytes are written deterministically
+		snap.PC = cpu.PC;
+		snap.SP = cpu.SP;
+		snap.A = cpu.A;
+		snap.X = cpu.X;
+		snap.Y = cpu.Y;
+		snap.PS = cpu.PS;
+
+		for(u32 p=0; p<PAGES_PER_MEM; p++){
+			if(!internPage(&memory.Data[p * PAGE_SIZE], snap.pages[p]))
+				return -1;
+		}
+		snap.packPages = numPages;
+
+		if(write(indexFd, &snap, sizeof(snap)) != static_cast<ssize_t>(sizeof(snap)))
+			return -1;
+
+		return numSnapshots++;
+	}
+
+	template<class Core>
+	bool load(u32 id, Core& cpu, Mem& memory) const{
+		Snapshot snap;
+		if(id >= numSnapshots ||
+		   pread(indexFd, &snap, sizeof(snap), static_cast<off_t>(id) * sizeof(snap)) != static_cast<ssize_t>(sizeof(snap)))
+			return false;
+
+		for(u32 p=0; p<PAGES_PER_MEM; p++){
+			if(snap.pages[p] >= numPages)
+				return false;
+			memcpy(&memory.Data[p * PAGE_SIZE], pagePtr(snap.pages[p]), PAGE_SIZE);
+		}
+
+		cpu.PC = snap.PC;
+		cpu.SP = snap.SP;
+		cpu.A = snap.A;
+		cpu.X = snap.X;
+		cpu.Y = snap.Y;
+		cpu.PS = snap.PS;
+		return true;
+	}
+};
+
+#endif
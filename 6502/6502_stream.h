@@ -0,0 +1,84 @@
+// Host <-> guest streaming I/O over lock-free single-producer/single-consumer rings
+
+#ifndef CPU_6502_STREAM_H
+#define CPU_6502_STREAM_H
+
+#include "6502_cpu.h"
+#include "6502_ring.h"
+
+namespace m6502{
+	template<u32 Capacity> struct StreamDevice;
+}
+
+// Streaming device with four registers from base :
+//   +0 DATA_IN   (R) next input byte; blocks while input is empty
+//   +1 IN_COUNT  (R) input bytes available, capped at 255
+//   +2 DATA_OUT  (W) queue an output byte; blocks while output is full
+//   +3 OUT_SPACE (R) free output bytes, capped at 255
+// The guest is the consumer of input and the producer of output; the host
+// thread feeds input and drains output through the rings directly, with
+// writeSpan/readSpan for copy-free access. A blocked DATA_IN/DATA_OUT access
+// leaves the ring untouched and the CPU retries the whole instruction.
+// A guest that blocked is parked by the executor, which resumes it once
+// ready() says the register it blocked on can make progress.
+template<m6502::u32 Capacity>
+struct m6502::StreamDevice : m6502::IODevice{
+	static constexpr Byte
+		REG_DATA_IN = 0,
+		REG_IN_COUNT = 1,
+		REG_DATA_OUT = 2,
+		REG_OUT_SPACE = 3;
+
+	SpscRing<Byte, Capacity> input;     // Host -> guest
+	SpscRing<Byte, Capacity> output;    // Guest -> host
+
+	explicit StreamDevice(Word baseAddr){
+		base = baseAddr;
+		size = 4;
+	}
+
+	Byte read(Word addr, bool& block) override{
+		switch(addr - base){
+			case REG_DATA_IN:{
+				Byte value = 0;
+				block = !input.pop(value);
+				return value;
+			}
+
+			case REG_IN_COUNT:{
+				u32 count = input.readable();
+				return count > 0xFF ? 0xFF : count;
+			}
+
+			case REG_OUT_SPACE:{
+				u32 space = output.writable();
+				return space > 0xFF ? 0xFF : space;
+			}
+
+			default:
+				return 0;
+		}
+	}
+
+	void write(Word addr, Byte value, bool& block) override{
+		if(addr - base != REG_DATA_OUT)
+			return;
+
+		block = !output.push(value);
+	}
+
+	// Executor thread : true when a guest blocked on this device can continue
+	bool ready(Word addr, bool write) override{
+		return write ? outputReady() : inputReady();
+	}
+
+	bool inputReady(){
+		return input.readable() > 0;
+	}
+
+	bool outputReady(){
+		return output.writable() > 0;
+	}
+};
+
+#endif
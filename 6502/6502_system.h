@@ -0,0 +1,119 @@
+// Multi-processor board : several CPUs on host threads sharing part of memory
+
+#ifndef CPU_6502_SYSTEM_H
+#define CPU_6502_SYSTEM_H
+
+#include <algorithm>
+#include <barrier>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "6502_cpu.h"
+
+namespace m6502{
+	struct SharedBus;
+	struct System;
+}
+
+// Maps a node's shared window. Reads see the node's local copy, which only
+// changes at window boundaries; writes land in the local copy and are logged
+// for publication to the other nodes.
+struct m6502::SharedBus : m6502::IODevice{
+	Mem* memory = nullptr;
+	std::vector<std::pair<Word, Byte>> log;
+
+	SharedBus(){
+		volatileReads = false;
+	}
+
+	Byte read(Word addr, bool&) override{
+		return (*memory)[addr];
+	}
+
+	void write(Word addr, Byte value, bool&) override{
+		(*memory)[addr] = value;
+		log.emplace_back(addr, value);
+	}
+};
+
+// Runs every node's CPU on its own host thread in lock-step windows of
+// quantum cycles. Each Mem is private except for [sharedBase, sharedBase +
+// sharedSize), which all nodes see. At each window barrier the buffered
+// shared writes are applied to the master image in node order, so a later
+// node wins on conflicts, and every node starts the next window from the
+// same published image. Results do not depend on host thread timing.
+struct m6502::System{
+	struct Node{
+		CPU cpu;
+		Mem memory;
+		SharedBus bus;
+		s32 overshoot = 0;      // Cycles the previous window ran over, charged to the next
+	};
+
+	std::vector<std::unique_ptr<Node>> nodes;
+	std::vector<Byte> shared;       // Published image of the shared window
+	Word sharedBase;
+	u32 quantum;
+
+	// The shared window is clipped at the top of memory
+	System(u32 numNodes, Word sharedBase, Word sharedSize, u32 quantum)
+		: shared(std::min<u32>(sharedSize, Mem::MAX_MEM - sharedBase), 0), sharedBase(sharedBase), quantum(quantum){
+		for(u32 i=0; i<numNodes; i++){
+			nodes.push_back(std::make_unique<Node>());
+
+			Node& node = *nodes.back();
+			node.bus.base = sharedBase;
+			node.bus.size = shared.size();
+			node.bus.memory = &node.memory;
+			node.cpu.devices = &node.bus;
+		}
+	}
+
+	Node& node(u32 i){
+		return *nodes[i];
+	}
+
+	// Called once all nodes have finished a window
+	void publish() noexcept{
+		for(auto& node : nodes){
+			for(auto& [addr, value] : node->bus.log){
+				shared[addr - sharedBase] = value;
+			}
+			node->bus.log.clear();
+		}
+	}
+
+	// Run for a number of windows. Nodes must be reset and loaded first;
+	// the shared window of every node is overwritten from shared.
+	void run(u32 windows){
+		std::barrier sync(nodes.size(), [this]() noexcept { publish(); });
+		std::vector<std::thread> threads;
+
+		for(auto& nodePtr : nodes){
+			Node* node = nodePtr.get();
+
+			threads.emplace_back([this, node, windows, &sync]{
+				for(u32 w=0; w<windows; w++){
+					memcpy(&node->memory.Data[sharedBase], shared.data(), shared.size());
+
+					if(!node->cpu.halted){
+						node->overshoot = node->cpu.exec(quantum + node->overshoot, node->memory);
+						if(node->overshoot > 0)
+							node->overshoot = 0;
+					}
+
+					sync.arrive_and_wait();
+				}
+				memcpy(&node->memory.Data[sharedBase], shared.data(), shared.size());
+			});
+		}
+
+		for(auto& thread : threads){
+			thread.join();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,155 @@
+// State telemetry : sampled CPU metrics exported from a background thread
+
+#ifndef CPU_6502_TELEMETRY_H
+#define CPU_6502_TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "6502_cpu.h"
+#include "6502_ring.h"
+
+namespace m6502{
+	struct Telemetry;
+	struct TelemetryExporter;
+}
+
+// Per-CPU sampler. The emulation thread pushes samples into a lock-free ring
+// and never waits : when the exporter falls behind, samples are dropped and
+// counted instead.
+struct m6502::Telemetry : m6502::StateSampler{
+	static constexpr u32 RING_SIZE = 1024;
+
+	u32 machine;
+	SpscRing<StateSample, RING_SIZE> ring;
+	std::atomic<u64> dropped{0};
+
+	// sampleInterval is in guest cycles
+	explicit Telemetry(u32 machineId, u32 sampleInterval = 1000000) : machine(machineId){
+		interval = sampleInterval;
+	}
+
+	void sample(const StateSample& state) override{
+		StateSample stamped = state;
+		stamped.hostNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		if(!ring.push(stamped))
+			dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+};
+
+// Drains a set of Telemetry rings on its own thread and writes one record per
+// sample, either as JSON lines or as raw Record structs. The newest record of
+// each machine can be queried from any thread with latest().
+struct m6502::TelemetryExporter{
+	struct Record{
+		u32 machine;
+		double ips;             // Guest instructions per host second since the previous sample
+		StateSample state;
+	};
+
+	enum class Format{ JSON_LINES, BINARY };
+
+	std::vector<Telemetry*> sources;
+	std::vector<Record> last;
+	std::vector<bool> seen;
+	std::mutex lastLock;
+
+	FILE* out;
+	Format format;
+	u32 pollMs;
+	std::atomic<bool> running{false};
+	std::thread worker;
+
+	TelemetryExporter(FILE* output, Format fmt = Format::JSON_LINES, u32 pollIntervalMs = 100)
+		: out(output), format(fmt), pollMs(pollIntervalMs){}
+
+	~TelemetryExporter(){
+		stop();
+	}
+
+	// Register sources before start()
+	void add(Telemetry& source){
+		sources.push_back(&source);
+		last.push_back(Record{ source.machine, 0.0, StateSample{} });
+		seen.push_back(false);
+	}
+
+	void start(){
+		running = true;
+		worker = std::thread([this]{
+			while(running.load(std::memory_order_relaxed)){
+				drain();
+				std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+			}
+			drain();
+		});
+	}
+
+	void stop(){
+		if(!running)
+			return;
+
+		running = false;
+		worker.join();
+		fflush(out);
+	}
+
+	bool latest(u32 machine, Record& record){
+		std::lock_guard<std::mutex> guard(lastLock);
+
+		for(u32 i=0; i<sources.size(); i++){
+			if(sources[i]->machine == machine && seen[i]){
+				record = last[i];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void drain(){
+		for(u32 i=0; i<sources.size(); i++){
+			StateSample state;
+
+			while(sources[i]->ring.pop(state)){
+				// Value-initialised so the padding after machine is zero in BINARY output
+				Record record{};
+				record.machine = sources[i]->machine;
+				record.state = state;
+
+				{
+					std::lock_guard<std::mutex> guard(lastLock);
+					const StateSample& prev = last[i].state;
+
+					if(seen[i] && state.hostNs > prev.hostNs)
+						record.ips = (state.instructions - prev.instructions) * 1e9 / (state.hostNs - prev.hostNs);
+
+					last[i] = record;
+					seen[i] = true;
+				}
+
+				write(record);
+			}
+		}
+	}
+
+	void write(const Record& record){
+		if(format == Format::BINARY){
+			fwrite(&record, sizeof(record), 1, out);
+			return;
+		}
+
+		const StateSample& s = record.state;
+		fprintf(out,
+			"{\"machine\":%u,\"t_ns\":%llu,\"cycles\":%llu,\"instructions\":%llu,\"idle_cycles\":%llu,\"ips\":%.0f,"
+			"\"pc\":%u,\"sp\":%u,\"a\":%u,\"x\":%u,\"y\":%u,\"ps\":%u}\n",
+			record.machine, s.hostNs, s.cycles, s.instructions, s.idleCycles, record.ips,
+			s.PC, s.SP, s.A, s.X, s.Y, s.PS);
+	}
+};
+
+#endif
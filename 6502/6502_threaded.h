@@ -0,0 +1,587 @@
+// Control-flow analysis and threaded-code precompilation of loaded ROM code
+
+#ifndef CPU_6502_THREADED_H
+#define CPU_6502_THREADED_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include "6502_cpu.h"
+
+namespace m6502{
+	template<class Core> struct ThreadedCode;
+}
+
+// Built once after a ROM is loaded. analyse() follows every path reachable
+// from the given entry points, splits it into basic blocks and lowers each
+// instruction into an Op : handler pointer, operand and base cycle cost,
+// stored contiguously in block order. Each Op also holds the index of its
+// fall-through and branch-target Ops, so straight-line code and loops run
+// without decoding or looking up PC. When no devices are attached, each
+// handler goes straight on to the next Op, across branches and jumps, for as
+// long as that Op cannot reach the end of the slice or the next sample, so
+// exec()'s loop only sees those points. It leaves the threaded path for live
+// decode at any PC it has not analysed and rejoins it at the next known PC.
+// Attached as the CPU's codeWatch, it drops every Op the guest overwrites, so
+// that code runs through live decode from then on; blocks still describe the
+// code as analysed. Host writes to Mem are not seen : call analyse() again
+// after changing code from the host.
+template<class Core>
+struct m6502::ThreadedCode : m6502::CodeWatch{
+	static constexpr u32 NONE = ~0u;
+	static constexpr u32 MAX_RUN = 256;    // Bounds the call depth where sibling calls are not optimised
+
+	struct Op;
+
+	// Shared by the handlers of one run of Ops
+	struct Run{
+		const Op* ops;
+		s32 floor;      // Go on to an Op only if it cannot take cycles to or below this
+		u32 next;       // Set at the end : Op index to run next, NONE to leave for live decode
+		u32 retired;    // Set at the end : Ops run
+	};
+
+	// A handler runs its Op and then calls the next one itself, as a sibling
+	// call, while run allows it. The cycle and retired counts are passed and
+	// returned by value so they stay in registers.
+	using Handler = s32 (*)(Core& cpu, Mem& memory, const Op& op, s32 cycles, u32 retired, Run& run);
+
+	struct Op{
+		Handler fn;
+		u32 next;       // Op index of the fall-through, NONE if not analysed; else always the next Op
+		u32 target;     // Op index of the branch/jump target, NONE if not analysed
+		Word pc;
+		Word operand;   // Immediate, address, or branch/jump target address
+		Byte opcode;
+		Byte length;
+		Byte cycles;    // Base cost; page crossings and taken branches add at run time
+		Byte worst;     // Base cost plus the most those can add
+	};
+
+	struct Block{
+		Word start;
+		u32 firstOp;
+		u32 numOps;
+		u32 succ[2];    // Successor block indices, NONE when absent
+	};
+
+	enum class Mode{ IMP, IM, ZP, ZPX, ZPY, ABS, ABSX, ABSY, INDX, INDY, REL };
+	enum class Flow{ NEXT, BRANCH, JUMP };
+
+	struct Decoded{
+		Handler fn;
+		Mode mode;
+		Flow flow;
+		Byte cycles;
+	};
+
+	std::vector<Op> ops;
+	std::vector<Block> blocks;
+	std::vector<u32> entry;     // Op index per PC, NONE when not analysed
+
+	//------------------------------------------------------------------
+	// Handlers
+
+	// Memory accesses go through the CPU so devices still see them; plain
+	// memory is its inlined fast path. Their cycles are already part of the
+	// Op's base cost.
+	static Byte load(Core& cpu, Mem& memory, Word addr){
+		s32 charged = 0;
+		return cpu.readByte(charged, addr, memory);
+	}
+
+	static void store(Core& cpu, Mem& memory, Word addr, Byte value){
+		s32 charged = 0;
+		cpu.writeByte(value, charged, addr, memory);
+	}
+
+	static Word pointer(Core& cpu, Mem& memory, Byte addr){
+		s32 charged = 0;
+		return cpu.readZeroPageWord(charged, addr, memory);
+	}
+
+	// Effective address, matching the live decoder including its page-crossing penalties
+	template<Mode M>
+	static Word address(Core& cpu, Mem& memory, const Op& op, s32& cycles){
+		if constexpr(M == Mode::ZP || M == Mode::ABS){
+			return op.operand;
+		}
+		else if constexpr(M == Mode::ZPX){
+			return static_cast<Byte>(op.operand + cpu.X);
+		}
+		else if constexpr(M == Mode::ZPY){
+			return static_cast<Byte>(op.operand + cpu.Y);
+		}
+		else if constexpr(M == Mode::ABSX || M == Mode::ABSY){
+			Word addr = op.operand + (M == Mode::ABSX ? cpu.X : cpu.Y);
+			if((op.operand ^ addr) >> 8)
+				cycles--;
+			return addr;
+		}
+		else if constexpr(M == Mode::INDX){
+			return pointer(cpu, memory, static_cast<Byte>(op.operand + cpu.X));
+		}
+		else{
+			static_assert(M == Mode::INDY);
+			return pointer(cpu, memory, static_cast<Byte>(op.operand + cpu.Y));
+		}
+	}
+
+	// Go on to Op index, or back to exec() when it is not analysed, may stop,
+	// block or be sampled, or the run is long enough
+	static s32 enter(Core& cpu, Mem& memory, u32 index, const Op* op, s32 cycles, u32 retired, Run& run){
+		retired++;
+
+		if(op && cycles - op->worst > run.floor && retired < MAX_RUN)
+			return op->fn(cpu, memory, *op, cycles, retired, run);
+
+		run.next = index;
+		run.retired = retired;
+		return cycles;
+	}
+
+	// A linked fall-through is always the next Op in the array
+	static s32 fallThrough(Core& cpu, Mem& memory, const Op& op, s32 cycles, u32 retired, Run& run){
+		return enter(cpu, memory, op.next, op.next == NONE ? nullptr : &op + 1, cycles, retired, run);
+	}
+
+	static s32 branchTo(Core& cpu, Mem& memory, const Op& op, s32 cycles, u32 retired, Run& run){
+		return enter(cpu, memory, op.target, op.target == NONE ? nullptr : run.ops + op.target, cycles, retired, run);
+	}
+
+	template<class Operation, Mode M>
+	static s32 readOp(Core& cpu, Mem& memory, const Op& op, s32 cycles, u32 retired, Run& run){
+		cycles -= op.cycles;
+
+		Byte value;
+		if constexpr(M == Mode::IM)
+			value = op.operand;
+		else
+			value = load(cpu, memory, address<M>(cpu, memory, op, cycles));
+
+		Operation::apply(cpu, value);
+		cpu.PC = op.pc + op.length;
+		return fallThrough(cpu, memory, op, cycles, retired, run);
+	}
+
+	template<class Operation, Mode M>
+	static s32 writeOp(Core& cpu, Mem& memory, const Op& op, s32 cycles, u32 retired, Run& run){
+		cycles -= op.cycles;
+		store(cpu, memory, address<M>(cpu, memory, op, cycles), Operation::value(cpu));
+		cpu.PC = op.pc + op.length;
+		return fallThrough(cpu, memory, op, cycles, retired, run);
+	}
+
+	template<class Operation>
+	static s32 impliedOp(Core& cpu, Mem& memory, const Op& op, s32 cycles, u32 retired, Run& run){
+		cycles -= op.cycles;
+		Operation::apply(cpu);
+		cpu.PC = op.pc + op.length;
+		return fallThrough(cpu, memory, op, cycles, retired, run);
+	}
+
+	template<class Condition>
+	static s32 branchOp(Core& cpu, Mem& memory, const Op& op, s32 cycles, u32 retired, Run& run){
+		cycles -= op.cycles;
+
+		if(!Condition::test(cpu)){
+			cpu.PC = op.pc + op.length;
+			return fallThrough(cpu, memory, op, cycles, retired, run);
+		}
+
+		cycles--;
+		if(((op.pc + op.length) ^ op.operand) >> 8)
+			cycles--;
+
+		cpu.PC = op.operand;
+		if(op.operand <= op.pc)
+			cpu.checkIdleLoop(cycles);
+		return branchTo(cpu, memory, op, cycles, retired, run);
+	}
+
+	static s32 jumpOp(Core& cpu, Mem& memory, const Op& op, s32 cycles, u32 retired, Run& run){
+		cycles -= op.cycles;
+		cpu.PC = op.operand;
+		if(op.operand <= op.pc)
+			cpu.checkIdleLoop(cycles);
+		return branchTo(cpu, memory, op, cycles, retired, run);
+	}
+
+	struct LDA{ static void apply(Core& c, Byte v){ c.A = v; c.setZeroAndNegativeFlags(c.A); } };
+	struct LDX{ static void apply(Core& c, Byte v){ c.X = v; c.setZeroAndNegativeFlags(c.X); } };
+	struct LDY{ static void apply(Core& c, Byte v){ c.Y = v; c.setZeroAndNegativeFlags(c.Y); } };
+	struct AND{ static void apply(Core& c, Byte v){ c.A &= v; c.setZeroAndNegativeFlags(c.A); } };
+	struct ORA{ static void apply(Core& c, Byte v){ c.A |= v; c.setZeroAndNegativeFlags(c.A); } };
+	struct EOR{ static void apply(Core& c, Byte v){ c.A ^= v; c.setZeroAndNegativeFlags(c.A); } };
+	struct BIT{
+		static void apply(Core& c, Byte v){
+			c.stflag.Z = !(c.A & v);
+			c.stflag.N = (v & Core::NegativeFlagBit) != 0;
+			c.stflag.V = (v & Core::OverflowFlagBit) != 0;
+		}
+	};
+
+	struct STA{ static Byte value(const Core& c){ return c.A; } };
+	struct STX{ static Byte value(const Core& c){ return c.X; } };
+	struct STY{ static Byte value(const Core& c){ return c.Y; } };
+
+	struct TAX{ static void apply(Core& c){ c.X = c.A; c.setZeroAndNegativeFlags(c.X); } };
+	struct TAY{ static void apply(Core& c){ c.Y = c.A; c.setZeroAndNegativeFlags(c.Y); } };
+	struct TXA{ static void apply(Core& c){ c.A = c.X; c.setZeroAndNegativeFlags(c.A); } };
+	struct TYA{ static void apply(Core& c){ c.A = c.Y; c.setZeroAndNegativeFlags(c.A); } };
+
+	struct IfCC{ static bool test(const Core& c){ return !c.stflag.C; } };
+	struct IfCS{ static bool test(const Core& c){ return c.stflag.C; } };
+	struct IfEQ{ static bool test(const Core& c){ return c.stflag.Z; } };
+	struct IfMI{ static bool test(const Core& c){ return c.stflag.N; } };
+	struct IfNE{ static bool test(const Core& c){ return !c.stflag.Z; } };
+	struct IfPL{ static bool test(const Core& c){ return !c.stflag.N; } };
+	struct IfVC{ static bool test(const Core& c){ return !c.stflag.V; } };
+	struct IfVS{ static bool test(const Core& c){ return c.stflag.V; } };
+
+	//------------------------------------------------------------------
+	// Decode table
+
+	// Handler, addressing mode and base cost for every opcode the live
+	// decoder implements for all variants. Returns false for the rest, e.g.
+	// variant-only opcodes, which are left to live decode.
+	static bool decode(Byte opcode, Decoded& d){
+		#define M6502_READ(NAME, OPER, MODE, CYC)  case Core::NAME: d = { &readOp<OPER, Mode::MODE>, Mode::MODE, Flow::NEXT, CYC }; return true;
+		#define M6502_WRITE(NAME, OPER, MODE, CYC) case Core::NAME: d = { &writeOp<OPER, Mode::MODE>, Mode::MODE, Flow::NEXT, CYC }; return true;
+		#define M6502_IMPLIED(NAME, OPER)          case Core::NAME: d = { &impliedOp<OPER>, Mode::IMP, Flow::NEXT, 2 }; return true;
+		#define M6502_BRANCH(NAME, COND)           case Core::NAME: d = { &branchOp<COND>, Mode::REL, Flow::BRANCH, 2 }; return true;
+
+		switch(opcode){
+			M6502_READ(INS_LDA_IM, LDA, IM, 2)
+			M6502_READ(INS_LDA_ZP, LDA, ZP, 3)
+			M6502_READ(INS_LDA_ZPX, LDA, ZPX, 4)
+			M6502_READ(INS_LDA_ABS, LDA, ABS, 4)
+			M6502_READ(INS_LDA_ABSX, LDA, ABSX, 4)
+			M6502_READ(INS_LDA_ABSY, LDA, ABSY, 4)
+			M6502_READ(INS_LDA_INDX, LDA, INDX, 6)
+			M6502_READ(INS_LDA_INDY, LDA, INDY, 6)
+
+			M6502_READ(INS_LDX_IM, LDX, IM, 2)
+			M6502_READ(INS_LDX_ZP, LDX, ZP, 3)
+			M6502_READ(INS_LDX_ZPY, LDX, ZPY, 4)
+			M6502_READ(INS_LDX_ABS, LDX, ABS, 4)
+			M6502_READ(INS_LDX_ABSY, LDX, ABSY, 4)
+
+			M6502_READ(INS_LDY_IM, LDY, IM, 2)
+			M6502_READ(INS_LDY_ZP, LDY, ZP, 3)
+			M6502_READ(INS_LDY_ZPX, LDY, ZPX, 4)
+			M6502_READ(INS_LDY_ABS, LDY, ABS, 4)
+			M6502_READ(INS_LDY_ABSX, LDY, ABSX, 4)
+
+			M6502_WRITE(INS_STA_ZP, STA, ZP, 3)
+			M6502_WRITE(INS_STA_ZPX, STA, ZPX, 4)
+			M6502_WRITE(INS_STA_ABS, STA, ABS, 4)
+			M6502_WRITE(INS_STA_ABSX, STA, ABSX, 4)
+			M6502_WRITE(INS_STA_ABSY, STA, ABSY, 4)
+			M6502_WRITE(INS_STA_INDX, STA, INDX, 6)
+			M6502_WRITE(INS_STA_INDY, STA, INDY, 6)
+
+			M6502_WRITE(INS_STX_ZP, STX, ZP, 3)
+			M6502_WRITE(INS_STX_ZPY, STX, ZPY, 4)
+			M6502_WRITE(INS_STX_ABS, STX, ABS, 4)
+
+			M6502_WRITE(INS_STY_ZP, STY, ZP, 3)
+			M6502_WRITE(INS_STY_ZPX, STY, ZPX, 4)
+			M6502_WRITE(INS_STY_ABS, STY, ABS, 4)
+
+			M6502_IMPLIED(INS_TAX, TAX)
+			M6502_IMPLIED(INS_TAY, TAY)
+			M6502_IMPLIED(INS_TXA, TXA)
+			M6502_IMPLIED(INS_TYA, TYA)
+
+			M6502_READ(INS_AND_IM, AND, IM, 2)
+			M6502_READ(INS_AND_ZP, AND, ZP, 3)
+			M6502_READ(INS_AND_ZPX, AND, ZPX, 4)
+			M6502_READ(INS_AND_ABS, AND, ABS, 4)
+			M6502_READ(INS_AND_ABSX, AND, ABSX, 4)
+			M6502_READ(INS_AND_ABSY, AND, ABSY, 4)
+			M6502_READ(INS_AND_INDX, AND, INDX, 6)
+			M6502_READ(INS_AND_INDY, AND, INDY, 6)
+
+			M6502_READ(INS_ORA_IM, ORA, IM, 2)
+			M6502_READ(INS_ORA_ZP, ORA, ZP, 3)
+			M6502_READ(INS_ORA_ZPX, ORA, ZPX, 4)
+			M6502_READ(INS_ORA_ABS, ORA, ABS, 4)
+			M6502_READ(INS_ORA_ABSX, ORA, ABSX, 4)
+			M6502_READ(INS_ORA_ABSY, ORA, ABSY, 4)
+			M6502_READ(INS_ORA_INDX, ORA, INDX, 6)
+			M6502_READ(INS_ORA_INDY, ORA, INDY, 6)
+
+			M6502_READ(INS_EOR_IM, EOR, IM, 2)
+			M6502_READ(INS_EOR_ZP, EOR, ZP, 3)
+			M6502_READ(INS_EOR_ZPX, EOR, ZPX, 4)
+			M6502_READ(INS_EOR_ABS, EOR, ABS, 4)
+			M6502_READ(INS_EOR_ABSX, EOR, ABSX, 4)
+			M6502_READ(INS_EOR_ABSY, EOR, ABSY, 4)
+			M6502_READ(INS_EOR_INDX, EOR, INDX, 6)
+			M6502_READ(INS_EOR_INDY, EOR, INDY, 6)
+
+			M6502_READ(INS_BIT_ZP, BIT, ZP, 3)
+			M6502_READ(INS_BIT_ABS, BIT, ABS, 4)
+
+			M6502_BRANCH(INS_BCC, IfCC)
+			M6502_BRANCH(INS_BCS, IfCS)
+			M6502_BRANCH(INS_BEQ, IfEQ)
+			M6502_BRANCH(INS_BMI, IfMI)
+			M6502_BRANCH(INS_BNE, IfNE)
+			M6502_BRANCH(INS_BPL, IfPL)
+			M6502_BRANCH(INS_BVC, IfVC)
+			M6502_BRANCH(INS_BVS, IfVS)
+
+			case Core::INS_JMP_ABS: d = { &jumpOp, Mode::ABS, Flow::JUMP, 3 }; return true;
+
+			default: return false;
+		}
+
+		#undef M6502_READ
+		#undef M6502_WRITE
+		#undef M6502_IMPLIED
+		#undef M6502_BRANCH
+	}
+
+	// Base cost plus the most a page crossing or taken branch can add
+	static Byte worstOf(const Decoded& d){
+		bool indexed = d.mode == Mode::ABSX || d.mode == Mode::ABSY || d.mode == Mode::INDY;
+		return d.cycles + (indexed ? 1 : 0) + (d.flow == Flow::BRANCH ? 2 : 0);
+	}
+
+	static Byte lengthOf(Mode mode){
+		switch(mode){
+			case Mode::IMP: return 1;
+			case Mode::ABS:
+			case Mode::ABSX:
+			case Mode::ABSY: return 3;
+			default: return 2;
+		}
+	}
+
+	//------------------------------------------------------------------
+	// Analysis
+
+	// Build the control-flow graph and threaded code for everything reachable from entries
+	void analyse(const Mem& memory, const std::vector<Word>& entries){
+		static constexpr u32 NUM_PC = Mem::MAX_MEM;
+
+		ops.clear();
+		blocks.clear();
+		entry.assign(NUM_PC, NONE);
+		std::fill(std::begin(watched), std::end(watched), false);
+
+		// Pass 1 : find reachable instructions and block leaders
+		std::vector<Byte> isInstr(NUM_PC, 0);
+		std::vector<Byte> isLeader(NUM_PC, 0);
+		std::vector<Word> work(entries);
+
+		for(Word pc : entries){
+			isLeader[pc] = 1;
+		}
+
+		while(!work.empty()){
+			Word pc = work.back();
+			work.pop_back();
+
+			while(!isInstr[pc]){
+				isInstr[pc] = 1;
+
+				Decoded d;
+				if(!decode(memory[pc], d))
+					break;          // Left to live decode
+
+				Word next = pc + lengthOf(d.mode);
+				if(d.flow == Flow::JUMP || d.flow == Flow::BRANCH){
+					Word target = operandOf(memory, pc, d);
+					isLeader[target] = 1;
+					work.push_back(target);
+
+					if(d.flow == Flow::JUMP)
+						break;
+					isLeader[next] = 1;
+				}
+				pc = next;
+			}
+		}
+
+		// Pass 2 : emit blocks in address order so fall-through Ops are adjacent
+		std::vector<Flow> flows;
+
+		for(u32 start=0; start<NUM_PC; start++){
+			Decoded d;
+			if(!isInstr[start] || !isLeader[start] || !decode(memory[start], d))
+				continue;
+
+			Block block{ static_cast<Word>(start), static_cast<u32>(ops.size()), 0, { NONE, NONE } };
+			Word pc = start;
+
+			for(;;){
+				Op op;
+				op.fn = d.fn;
+				op.next = op.target = NONE;
+				op.pc = pc;
+				op.operand = operandOf(memory, pc, d);
+				op.opcode = memory[pc];
+				op.length = lengthOf(d.mode);
+				op.cycles = d.cycles;
+				op.worst = worstOf(d);
+
+				entry[pc] = ops.size();
+				ops.push_back(op);
+				watched[pc >> 8] = true;
+				watched[static_cast<Word>(pc + op.length - 1) >> 8] = true;
+				flows.push_back(d.flow);
+				block.numOps++;
+
+				Word next = pc + op.length;
+				if(d.flow != Flow::NEXT || isLeader[next] || !isInstr[next] || !decode(memory[next], d))
+					break;
+				pc = next;
+			}
+			blocks.push_back(block);
+		}
+
+		// Pass 3 : link Ops and blocks now that every reachable PC has an index
+		for(u32 i=0; i<ops.size(); i++){
+			Op& op = ops[i];
+
+			// A block jumped into mid-instruction can sit between the two
+			if(flows[i] != Flow::JUMP && entry[static_cast<Word>(op.pc + op.length)] == i + 1)
+				op.next = i + 1;
+			if(flows[i] == Flow::JUMP || flows[i] == Flow::BRANCH)
+				op.target = entry[op.operand];
+		}
+
+		for(Block& block : blocks){
+			const Op& last = ops[block.firstOp + block.numOps - 1];
+			u32 succ[2] = { last.next, last.target };
+
+			for(u32 i=0; i<2; i++){
+				block.succ[i] = (succ[i] == NONE) ? NONE : blockOf(succ[i]);
+			}
+		}
+	}
+
+	static Word operandOf(const Mem& memory, Word pc, const Decoded& d){
+		switch(d.mode){
+			case Mode::IMP:
+				return 0;
+			case Mode::ABS:
+			case Mode::ABSX:
+			case Mode::ABSY:
+				return memory[static_cast<Word>(pc + 1)] | (memory[static_cast<Word>(pc + 2)] << 8);
+			case Mode::REL:
+				return pc + 2 + static_cast<signed char>(memory[static_cast<Word>(pc + 1)]);
+			default:
+				return memory[static_cast<Word>(pc + 1)];
+		}
+	}
+
+	// Drop the Op of every instruction whose bytes include addr
+	void codeWritten(Word addr) override{
+		for(u32 back=0; back<3; back++){
+			Word pc = addr - back;
+			u32 index = entry[pc];
+
+			if(index != NONE && ops[index].length > back)
+				invalidate(index);
+		}
+	}
+
+	// Unlink an Op so neither PC lookup nor a neighbour's next/target reaches it
+	void invalidate(u32 index){
+		entry[ops[index].pc] = NONE;
+
+		for(Op& op : ops){
+			if(op.next == index)
+				op.next = NONE;
+			if(op.target == index)
+				op.target = NONE;
+		}
+	}
+
+	// Block containing op index, by binary search on firstOp
+	u32 blockOf(u32 opIndex) const{
+		auto it = std::upper_bound(blocks.begin(), blocks.end(), opIndex,
+			[](u32 index, const Block& block){ return index < block.firstOp; });
+		return static_cast<u32>(it - blocks.begin()) - 1;
+	}
+
+	//------------------------------------------------------------------
+	// Execution
+
+	// Same contract as CPU::exec, running threaded Ops where analysed
+	s32 exec(Core& cpu, Mem& memory, s32 cycles) const{
+		if(cpu.halted)
+			return cycles;
+
+		const s32 budget = cycles;
+		cpu.waitingIO = false;
+		cpu.idleArmed = false;
+
+		// Only devices can block and the profiler needs every instruction, so
+		// otherwise handlers go on until an Op could reach a stop or sample
+		bool chained = !cpu.devices;
+#ifdef M6502_PERF
+		chained = chained && !cpu.profiler;
+#endif
+
+		u32 index = entry.empty() ? NONE : entry[cpu.PC];
+		s32 sampleBelow = cpu.sampleThreshold(budget);
+		auto floor = [&]{ return chained ? std::max(sampleBelow, 0) : INT32_MAX; };
+		Run run{ ops.data(), floor(), NONE, 0 };
+
+		while(cycles > 0 && !cpu.waitingIO){
+			if(index != NONE){
+				const Op& op = ops[index];
+				const s32 instrCycles = cycles;
+#ifdef M6502_PERF
+				if(cpu.profiler)
+					cpu.profiler->begin(op.pc);
+#endif
+				cycles = op.fn(cpu, memory, op, cycles, 0, run);
+				index = run.next;
+
+				if(cpu.waitingIO){
+					cpu.rollback(op.pc, instrCycles, cycles);
+					break;
+				}
+
+#ifdef M6502_PERF
+				if(cpu.profiler)
+					cpu.profiler->end(op.pc, op.opcode, instrCycles - cycles, cpu.PC);
+#endif
+
+				cpu.instructionsRetired += run.retired;
+				if(cycles <= sampleBelow){
+					cpu.sampleState(cpu.cyclesElapsed + (budget - cycles));
+					sampleBelow = cpu.sampleThreshold(budget);
+					run.floor = floor();
+				}
+			}
+			else{
+				cycles = cpu.template run<true>(cycles, budget, memory);
+				if(cpu.halted)
+					break;
+				sampleBelow = cpu.sampleThreshold(budget);
+				run.floor = floor();
+			}
+
+			if(index == NONE && !entry.empty())
+				index = entry[cpu.PC];
+		}
+
+#ifdef M6502_PERF
+		if(cpu.profiler)
+			cpu.profiler->pause();
+#endif
+
+		cpu.cyclesElapsed += budget - cycles;
+		return cycles;
+	}
+};
+
+#endif
@@ -0,0 +1,89 @@
+// Executor behaviour : a guest parks on an empty DATA_IN and resumes by
+// itself once input is pushed, bounded runReady() hands control back while a
+// guest keeps yielding, overshoot is carried between quanta, and a halted
+// guest finishes. Built and run by "make check".
+
+#include <cstdio>
+#include "6502_coro.h"
+#include "6502_cpu.h"
+#include "6502_stream.h"
+
+using namespace m6502;
+
+static u32 failed = 0;
+
+static void expect(bool ok, const char* what){
+    if(!ok){
+        printf("coro_check : %s\n", what);
+        failed++;
+    }
+}
+
+static void load(Mem& memory, Word addr, std::initializer_list<Byte> bytes){
+    for(Byte b : bytes){
+        memory[addr++] = b;
+    }
+}
+
+int main(){
+    static Mem echoMem, spinMem, loadMem, haltMem;
+    static StreamDevice<16> stream(0xD000);
+    CPU echo, spin, loads, halts;
+    Executor executor;
+
+    // Echo : LDA $D000 ; STA $D002 ; JMP E000
+    echo.reset(0xE000, echoMem);
+    load(echoMem, 0xE000, { 0xAD, 0x00, 0xD0, 0x8D, 0x02, 0xD0, 0x4C, 0x00, 0xE0 });
+    echo.devices = &stream;
+
+    // Spin : JMP * ; always runnable
+    spin.reset(0xE000, spinMem);
+    load(spinMem, 0xE000, { 0x4C, 0x00, 0xE0 });
+
+    // Loads : LDA $0200 repeated, 4 cycles each against a 5-cycle quantum
+    loads.reset(0xE000, loadMem);
+    for(Word addr=0xE000; addr<0xE300; addr+=3){
+        load(loadMem, addr, { 0xAD, 0x00, 0x02 });
+    }
+
+    // Halts : LDA #1 ; unhandled opcode
+    halts.reset(0xE000, haltMem);
+    load(haltMem, 0xE000, { 0xA9, 0x01, 0x02 });
+
+    u32 echoId = executor.spawn(echo, echoMem, 100);
+    u32 haltId = executor.spawn(halts, haltMem, 100);
+
+    // Only the echo guest and the halting guest : runReady() drains and returns
+    executor.runReady();
+    expect(executor.done(haltId), "halted guest finishes");
+    expect(!executor.done(echoId) && echo.waitingIO, "echo guest parks on empty DATA_IN");
+    expect(executor.runReady(8) == 0, "nothing runnable while input is empty");
+
+    // Input alone resumes it; no wake() needed
+    stream.input.push(0x5A);
+    executor.runReady();
+    Byte out = 0;
+    expect(stream.output.pop(out) && out == 0x5A, "pushed input is echoed without wake()");
+
+    // With a guest that always yields, bounded calls still return
+    u32 spinId = executor.spawn(spin, spinMem, 100);
+    expect(executor.runReady(4) == 4, "bounded runReady returns after maxResumes quanta");
+
+    stream.input.push(0xA5);
+    for(u32 i=0; i<4; i++){
+        executor.runReady(executor.guests.size());
+    }
+    expect(stream.output.pop(out) && out == 0xA5, "parked guest resumes while another keeps yielding");
+    expect(!executor.done(spinId), "yielding guest keeps running");
+
+    // Ten 5-cycle quanta of 4-cycle loads : the overshoot of each is charged to the next
+    Executor solo;
+    solo.spawn(loads, loadMem, 5);
+    for(u32 i=0; i<10; i++){
+        solo.runReady(1);
+    }
+    expect(loads.cyclesElapsed >= 50 && loads.cyclesElapsed < 54, "overshoot is carried between quanta");
+
+    printf("coro_check : %u failures\n", failed);
+    return failed ? 1 : 0;
+}
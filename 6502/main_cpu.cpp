@@ -26,11 +26,21 @@ int main(){
     // // inline code segment : end
     // ******************************************
 
+#ifdef M6502_PERF
+    m6502::HostProfiler profiler;
+    profiler.addRegion(0xE000, 0xFFFF, "ROM");
+    cpu.profiler = &profiler;
+#endif
+
     cout << "\nInitial register status\n";
     cpu.printStatus();
     cpu.exec(6, mem);
     cout << "Final register status\n";
     cpu.printStatus();
 
+#ifdef M6502_PERF
+    profiler.report();
+#endif
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+// PageStore behaviour : snapshots survive reopening, a crash-truncated index
+// loses only the partial record, and a failed open leaves the store intact.
+// Built and run by "make check".
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "6502_cpu.h"
+#include "6502_snapshot.h"
+
+using namespace m6502;
+
+static u32 failed = 0;
+
+static void expect(bool ok, const char* what){
+    if(!ok){
+        printf("snapshot_check : %s\n", what);
+        failed++;
+    }
+}
+
+static off_t fileSize(const std::string& path){
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+int main(){
+    char dir[] = "/tmp/snapshot_checkXXXXXX";
+    if(!mkdtemp(dir))
+        return 1;
+
+    const std::string path = std::string(dir) + "/store";
+    static Mem memory, restored;
+    CPU cpu, loaded;
+    cpu.reset(0xE000, memory);
+
+    // Five snapshots that differ in one RAM page and in A
+    {
+        PageStore store;
+        expect(store.open(path), "open new store");
+
+        for(u32 i=0; i<5; i++){
+            memory[0x0200] = i;
+            cpu.A = i;
+            expect(store.save(cpu, memory) == static_cast<s32>(i), "save returns sequential ids");
+        }
+    }
+
+    const off_t packSize = fileSize(path);
+    {
+        PageStore store;
+        expect(store.open(path), "reopen store");
+        expect(store.numSnapshots == 5, "reopen sees every snapshot");
+        expect(static_cast<off_t>(store.numPages) * PageStore::PAGE_SIZE == packSize, "reopen sees every page");
+
+        expect(store.load(3, loaded, restored), "load snapshot 3");
+        expect(loaded.A == 3 && restored[0x0200] == 3, "snapshot 3 restores A and RAM");
+        expect(memcmp(restored.Data + 0x0300, memory.Data + 0x0300, Mem::MAX_MEM - 0x0300) == 0, "shared pages restore");
+        expect(!store.load(5, loaded, restored), "load past the end fails");
+    }
+
+    // A crash halfway through appending a record
+    FILE* index = fopen((path + ".idx").c_str(), "ab");
+    fwrite("partial", 1, 7, index);
+    fclose(index);
+    {
+        PageStore store;
+        expect(store.open(path), "open with a truncated index");
+        expect(store.numSnapshots == 5, "partial record is dropped");
+        expect(fileSize(path + ".idx") == static_cast<off_t>(5 * sizeof(PageStore::Snapshot)), "index trimmed to whole records");
+
+        memory[0x0200] = 0x55;
+        expect(store.save(cpu, memory) == 5, "save after recovery appends");
+        expect(store.load(5, loaded, restored) && restored[0x0200] == 0x55, "appended snapshot loads");
+    }
+
+    // An index that cannot be opened must not cost the pack its pages
+    const off_t keptSize = fileSize(path);
+    rename((path + ".idx").c_str(), (path + ".bak").c_str());
+    mkdir((path + ".idx").c_str(), 0755);
+    {
+        PageStore store;
+        expect(!store.open(path), "open fails without an index");
+    }
+    expect(fileSize(path) == keptSize, "failed open leaves the pack untouched");
+
+    rmdir((path + ".idx").c_str());
+    remove((path + ".bak").c_str());
+    remove(path.c_str());
+    rmdir(dir);
+
+    printf("snapshot_check : %u failures\n", failed);
+    return failed ? 1 : 0;
+}
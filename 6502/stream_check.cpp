@@ -0,0 +1,67 @@
+// StreamDevice behaviour : an access that blocks leaves the CPU at the start
+// of the instruction with its registers unchanged, and the instruction
+// completes once the host makes room. Built and run by "make check".
+
+#include <cstdio>
+#include "6502_cpu.h"
+#include "6502_stream.h"
+
+using namespace m6502;
+
+static u32 failed = 0;
+
+static void expect(bool ok, const char* what){
+    if(!ok){
+        printf("stream_check : %s\n", what);
+        failed++;
+    }
+}
+
+int main(){
+    static Mem memory;
+    static StreamDevice<1> stream(0xD000);
+    CPU cpu;
+
+    // E000 LDA $D000 ; E003 STA $10 ; E005 STA $D002 ; E008 STA $D002 ; E00B JMP E00B
+    const Byte program[] = {
+        0xAD, 0x00, 0xD0,
+        0x85, 0x10,
+        0x8D, 0x02, 0xD0,
+        0x8D, 0x02, 0xD0,
+        0x4C, 0x0B, 0xE0
+    };
+
+    cpu.reset(0xE000, memory);
+    for(u32 i=0; i<sizeof(program); i++){
+        memory[0xE000 + i] = program[i];
+    }
+    cpu.devices = &stream;
+    cpu.A = 0x11;
+
+    // Empty input : LDA is rolled back
+    cpu.exec(100, memory);
+    expect(cpu.waitingIO, "read of empty DATA_IN blocks");
+    expect(cpu.PC == 0xE000 && cpu.A == 0x11, "blocked read leaves PC and A unchanged");
+    expect(cpu.cyclesElapsed == 0 && cpu.instructionsRetired == 0, "blocked read is not charged");
+    expect(cpu.blockedOn.device == &stream && !cpu.blockedOn.write && !cpu.blockedOn.ready(), "blocked read is recorded");
+
+    // Input arrives : LDA retries, first store fills the one-slot output, second blocks
+    stream.input.push(0x42);
+    expect(cpu.blockedOn.ready(), "pushed input makes the read ready");
+    cpu.exec(100, memory);
+    expect(memory[0x10] == 0x42, "retried read delivers the byte");
+    expect(cpu.waitingIO && cpu.PC == 0xE008, "write to full DATA_OUT blocks at its instruction");
+    expect(cpu.blockedOn.write && !cpu.blockedOn.ready(), "blocked write is recorded");
+
+    // Host drains output : the blocked store is retried and delivered
+    Byte first = 0, second = 0;
+    stream.output.pop(first);
+    cpu.exec(100, memory);
+    stream.output.pop(second);
+    expect(!cpu.waitingIO && cpu.PC == 0xE00B, "retried write completes");
+    expect(first == 0x42 && second == 0x42, "each store delivers exactly one byte");
+    expect(stream.output.readable() == 0, "no duplicate output");
+
+    printf("stream_check : %u failures\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+// System and slice accounting behaviour : shared writes become visible to
+// other nodes only after the window they were made in, cycle overshoot is
+// carried into the next window, the shared range is clipped at the top of
+// memory, and a halted CPU stops at the bad opcode without consuming cycles.
+// Built and run by "make check".
+
+#include <cstdio>
+#include "6502_cpu.h"
+#include "6502_system.h"
+#include "6502_threaded.h"
+
+using namespace m6502;
+
+static u32 failed = 0;
+
+static void expect(bool ok, const char* what){
+    if(!ok){
+        printf("system_check : %s\n", what);
+        failed++;
+    }
+}
+
+static void load(Mem& memory, Word addr, std::initializer_list<Byte> bytes){
+    for(Byte b : bytes){
+        memory[addr++] = b;
+    }
+}
+
+static void mailbox(){
+    System system(2, 0x0300, 0x10, 20);
+
+    for(u32 i=0; i<2; i++){
+        system.node(i).cpu.reset(0xE000, system.node(i).memory);
+    }
+
+    // Node 0 : LDA #$42 ; STA $0300 ; JMP *
+    load(system.node(0).memory, 0xE000, { 0xA9, 0x42, 0x8D, 0x00, 0x03, 0x4C, 0x05, 0xE0 });
+    // Node 1 : LDA $0300 ; STA $10 ; JMP E000
+    load(system.node(1).memory, 0xE000, { 0xAD, 0x00, 0x03, 0x85, 0x10, 0x4C, 0x00, 0xE0 });
+
+    system.run(1);
+    expect(system.shared[0] == 0x42, "write is published at the window barrier");
+    expect(system.node(1).memory[0x10] == 0, "write is not visible to other nodes inside its window");
+
+    system.run(1);
+    expect(system.node(1).memory[0x10] == 0x42, "write is visible in the next window");
+}
+
+static void overshoot(){
+    System system(1, 0x0300, 0x10, 5);
+    CPU& cpu = system.node(0).cpu;
+    Mem& memory = system.node(0).memory;
+
+    // LDA $0200 repeated : 4 cycles each, so every 5-cycle window overshoots
+    cpu.reset(0xE000, memory);
+    for(Word addr=0xE000; addr<0xE100; addr+=3){
+        load(memory, addr, { 0xAD, 0x00, 0x02 });
+    }
+
+    system.run(10);
+    expect(cpu.cyclesElapsed >= 50 && cpu.cyclesElapsed < 54, "ten 5-cycle windows run about 50 cycles");
+}
+
+static void clipped(){
+    System system(2, 0xFF80, 0x100, 10);
+    expect(system.shared.size() == 0x80, "shared window is clipped at the top of memory");
+    expect(system.node(0).bus.size == 0x80 && !system.node(0).bus.maps(0x0000), "clipped bus does not wrap into zero page");
+
+    for(u32 i=0; i<2; i++){
+        system.node(i).cpu.reset(0xE000, system.node(i).memory);
+        load(system.node(i).memory, 0xE000, { 0x4C, 0x00, 0xE0 });
+    }
+    system.run(2);
+}
+
+template<class Exec>
+static void halt(const char* name, Exec exec){
+    static Mem memory;
+    CPU cpu;
+
+    // LDA #1 ; then an opcode no variant implements
+    cpu.reset(0xE000, memory);
+    load(memory, 0xE000, { 0xA9, 0x01, 0x02 });
+
+    s32 left = exec(cpu, memory, 100);
+    expect(cpu.halted && cpu.PC == 0xE002, name);
+    expect(left == 98 && cpu.cyclesElapsed == 2 && cpu.instructionsRetired == 1, "halt charges only executed cycles");
+
+    left = exec(cpu, memory, 100);
+    expect(left == 100 && cpu.PC == 0xE002 && cpu.cyclesElapsed == 2, "exec on a halted CPU does nothing");
+}
+
+int main(){
+    mailbox();
+    overshoot();
+    clipped();
+
+    halt("live decode stops at the unhandled opcode", [](CPU& cpu, Mem& memory, s32 cycles){
+        return cpu.exec(cycles, memory);
+    });
+    halt("threaded code stops at the unhandled opcode", [](CPU& cpu, Mem& memory, s32 cycles){
+        static ThreadedCode<CPU> code;
+        code.analyse(memory, { 0xE000 });
+        return code.exec(cpu, memory, cycles);
+    });
+
+    printf("system_check : %u failures\n", failed);
+    return failed ? 1 : 0;
+}
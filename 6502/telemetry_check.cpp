@@ -0,0 +1,112 @@
+// Telemetry behaviour : an idle guest keeps being sampled on guest cycles
+// (once per skipped stretch, since idle-loop skipping jumps over sample points),
+// the exporter writes one JSON line per sample with the sampled state,
+// latest() returns the newest record, and BINARY records have zeroed
+// padding. Built and run by "make check".
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "6502_cpu.h"
+#include "6502_telemetry.h"
+
+using namespace m6502;
+
+static u32 failed = 0;
+
+static void expect(bool ok, const char* what){
+    if(!ok){
+        printf("telemetry_check : %s\n", what);
+        failed++;
+    }
+}
+
+// Three 3000-cycle slices of an idle loop, sampled every 1000 cycles
+static void runIdle(CPU& cpu, Mem& memory){
+    // LDA #1 ; JMP E002
+    cpu.reset(0xE000, memory);
+    const Byte program[] = { 0xA9, 0x01, 0x4C, 0x02, 0xE0 };
+    for(u32 i=0; i<sizeof(program); i++){
+        memory[0xE000 + i] = program[i];
+    }
+
+    for(u32 i=0; i<3; i++){
+        cpu.exec(3000, memory);
+    }
+}
+
+int main(){
+    static Mem memory;
+    CPU cpu;
+
+    // JSON lines
+    {
+        Telemetry telemetry(7, 1000);
+        cpu.sampler = &telemetry;
+
+        FILE* out = tmpfile();
+        TelemetryExporter exporter(out, TelemetryExporter::Format::JSON_LINES, 1);
+        exporter.add(telemetry);
+        exporter.start();
+        runIdle(cpu, memory);
+        exporter.stop();
+
+        expect(cpu.idleCyclesSkipped > 0, "guest is fast-forwarded by idle-loop skipping");
+
+        rewind(out);
+        char line[512];
+        u32 lines = 0;
+        bool fields = true;
+        while(fgets(line, sizeof(line), out)){
+            lines++;
+            fields &= strstr(line, "\"machine\":7,") != nullptr;
+            fields &= strstr(line, "\"a\":1,") != nullptr || lines == 1;
+            fields &= strstr(line, "\"idle_cycles\":") != nullptr && line[strlen(line) - 1] == '\n';
+        }
+        fclose(out);
+
+        expect(lines >= 3, "idle guest is sampled in every slice");
+        expect(fields, "JSON lines carry machine, registers and idle cycles");
+        expect(telemetry.dropped == 0, "no samples dropped");
+
+        TelemetryExporter::Record record;
+        expect(exporter.latest(7, record), "latest() finds the machine");
+        expect(record.state.cycles > 8000 && record.state.cycles <= cpu.cyclesElapsed, "latest() is the newest sample");
+        expect(!exporter.latest(8, record), "latest() rejects unknown machines");
+    }
+
+    // Binary records
+    {
+        Telemetry telemetry(3, 1000);
+        cpu.sampler = &telemetry;
+
+        FILE* out = tmpfile();
+        TelemetryExporter exporter(out, TelemetryExporter::Format::BINARY, 1);
+        exporter.add(telemetry);
+        exporter.start();
+        runIdle(cpu, memory);
+        exporter.stop();
+
+        rewind(out);
+        TelemetryExporter::Record record;
+        u32 records = 0;
+        bool zeroPadding = true;
+        while(fread(&record, sizeof(record), 1, out) == 1){
+            records++;
+
+            Byte raw[sizeof(record)];
+            memcpy(raw, &record, sizeof(record));
+            for(u32 i=sizeof(record.machine); i<offsetof(TelemetryExporter::Record, ips); i++){
+                zeroPadding &= raw[i] == 0;
+            }
+        }
+        fclose(out);
+
+        expect(records >= 3, "binary output has one record per sample");
+        expect(zeroPadding, "binary records have zeroed padding");
+    }
+
+    cpu.sampler = nullptr;
+    printf("telemetry_check : %u failures\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+// Times CPU::exec against ThreadedCode::exec on the same guest programs and
+// fails when threaded code is not faster than live decode, or when the two
+// end in different states. Built and run by "make check".
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "6502_cpu.h"
+#include "6502_threaded.h"
+
+using namespace m6502;
+
+static constexpr Word CODE_BASE = 0xE000;
+static constexpr u32 REPS = 25;
+static constexpr u32 SLICES = 100;
+static constexpr s32 SLICE_CYCLES = 100000;
+
+static u32 failed = 0;
+
+// 25 x (LDA zp ; STA abs ; TAX ; LDA abs,X) then JMP back : one long block
+static void straightLine(Mem& memory){
+    Word pc = CODE_BASE;
+    for(u32 i=0; i<25; i++){
+        const Byte code[] = { 0xA5, static_cast<Byte>(0x10 + i % 8), 0x8D, static_cast<Byte>(i), 0x02, 0xAA, 0xBD, 0x00, 0x02 };
+        for(Byte b : code){
+            memory[pc++] = b;
+        }
+    }
+    const Byte jump[] = { 0x4C, CODE_BASE & 0xFF, CODE_BASE >> 8 };
+    for(Byte b : jump){
+        memory[pc++] = b;
+    }
+}
+
+// LDA zp ; AND #1 ; BEQ +3 ; STA $0200 ; LDX zp ; STX zp ; JMP back : short blocks
+static void shortBlocks(Mem& memory){
+    const Byte code[] = {
+        0xA5, 0x10,
+        0x29, 0x01,
+        0xF0, 0x03,
+        0x8D, 0x00, 0x02,
+        0xA6, 0x11,
+        0x86, 0x10,
+        0x4C, CODE_BASE & 0xFF, CODE_BASE >> 8
+    };
+    for(u32 i=0; i<sizeof(code); i++){
+        memory[CODE_BASE + i] = code[i];
+    }
+}
+
+// Best of REPS for each, alternating so both see the same machine load
+template<class Live, class Threaded>
+static void best(Live live, Threaded threaded, double& liveTime, double& threadedTime){
+    liveTime = threadedTime = 1e9;
+    for(u32 rep=0; rep<REPS; rep++){
+        auto start = std::chrono::steady_clock::now();
+        live();
+        auto middle = std::chrono::steady_clock::now();
+        threaded();
+        auto end = std::chrono::steady_clock::now();
+
+        liveTime = std::min(liveTime, std::chrono::duration<double>(middle - start).count());
+        threadedTime = std::min(threadedTime, std::chrono::duration<double>(end - middle).count());
+    }
+}
+
+static void bench(const char* name, void (*program)(Mem&)){
+    static Mem liveMem, threadedMem;
+    CPU live, threaded;
+    ThreadedCode<CPU> code;
+
+    live.reset(CODE_BASE, liveMem);
+    threaded.reset(CODE_BASE, threadedMem);
+    for(Mem* memory : { &liveMem, &threadedMem }){
+        for(u32 i=0; i<0x100; i++){
+            (*memory)[i] = i * 7;
+        }
+        program(*memory);
+    }
+    code.analyse(threadedMem, { CODE_BASE });
+    threaded.codeWatch = &code;
+
+    double liveTime, threadedTime;
+    best([&]{
+        for(u32 i=0; i<SLICES; i++){
+            live.exec(SLICE_CYCLES, liveMem);
+        }
+    }, [&]{
+        for(u32 i=0; i<SLICES; i++){
+            code.exec(threaded, threadedMem, SLICE_CYCLES);
+        }
+    }, liveTime, threadedTime);
+
+    bool same = live.PC == threaded.PC && live.A == threaded.A && live.X == threaded.X
+        && live.cyclesElapsed == threaded.cyclesElapsed && live.instructionsRetired == threaded.instructionsRetired
+        && memcmp(liveMem.Data, threadedMem.Data, sizeof(liveMem.Data)) == 0;
+
+    printf("threaded_bench : %-12s live %.4fs threaded %.4fs (%.2fx)\n", name, liveTime, threadedTime, liveTime / threadedTime);
+    if(!same){
+        printf("threaded_bench : %s ends in a different state\n", name);
+        failed++;
+    }
+    if(threadedTime >= liveTime){
+        printf("threaded_bench : %s is not faster threaded\n", name);
+        failed++;
+    }
+}
+
+int main(){
+    bench("straight-line", straightLine);
+    bench("short blocks", shortBlocks);
+
+    printf("threaded_bench : %u failures\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+// Runs random programs through CPU::exec and ThreadedCode::exec side by side
+// and checks that both leave identical registers, counters and memory after
+// every quantum. Built and run by "make check".
+
+#include <cstring>
+#include <random>
+#include "6502_cpu.h"
+#include "6502_threaded.h"
+
+using namespace m6502;
+
+static constexpr Word CODE_BASE = 0xE000;
+static constexpr Word CODE_SIZE = 0x0400;
+static constexpr Word DATA_BASE = 0x0200;
+
+// Fill [CODE_BASE, CODE_BASE + CODE_SIZE) with instructions the threaded
+// decoder knows, ending in a jump back to the start. Jumps and branches land
+// on instruction starts, and loads and stores hit zero page or the data page.
+// With selfModify, some absolute stores rewrite the operand of an immediate
+// instruction instead, so the guest changes code it is running.
+template<class Core>
+static void generate(std::mt19937& rng, Mem& memory, bool selfModify){
+    using Code = ThreadedCode<Core>;
+
+    std::vector<Word> starts;
+    Word pc = CODE_BASE;
+
+    while(pc < CODE_BASE + CODE_SIZE - 8){
+        typename Code::Decoded d;
+        Byte opcode = rng();
+        if(!Code::decode(opcode, d))
+            continue;
+
+        starts.push_back(pc);
+        memory[pc] = opcode;
+
+        Word operand = rng();
+        switch(d.mode){
+            case Code::Mode::ABS:
+            case Code::Mode::ABSX:
+            case Code::Mode::ABSY:
+                operand = DATA_BASE + (rng() & 0xFF);
+                memory[pc + 1] = operand & 0xFF;
+                memory[pc + 2] = operand >> 8;
+                break;
+
+            case Code::Mode::IMP:
+                break;
+
+            default:
+                memory[pc + 1] = operand;
+                break;
+        }
+        pc += Code::lengthOf(d.mode);
+    }
+
+    std::vector<Word> immediates;
+    for(Word start : starts){
+        typename Code::Decoded d;
+        Code::decode(memory[start], d);
+        if(d.mode == Code::Mode::IM)
+            immediates.push_back(start + 1);
+    }
+
+    // Now that every instruction start is known, aim control flow and code writes
+    for(Word start : starts){
+        typename Code::Decoded d;
+        Code::decode(memory[start], d);
+
+        Word target = starts[rng() % starts.size()];
+        if(d.flow == Code::Flow::BRANCH){
+            s32 offset = target - (start + 2);
+            memory[start + 1] = (offset >= -128 && offset <= 127) ? static_cast<Byte>(offset) : 0;
+        }
+        else if(d.flow == Code::Flow::JUMP ||
+                (selfModify && d.mode == Code::Mode::ABS && !immediates.empty() && rng() % 2 == 0)){
+            if(d.flow != Code::Flow::JUMP)
+                target = immediates[rng() % immediates.size()];
+            memory[start + 1] = target & 0xFF;
+            memory[start + 2] = target >> 8;
+        }
+    }
+
+    memory[pc] = Core::INS_JMP_ABS;
+    memory[pc + 1] = CODE_BASE & 0xFF;
+    memory[pc + 2] = CODE_BASE >> 8;
+}
+
+template<class Core>
+static bool same(const Core& a, const Mem& ma, const Core& b, const Mem& mb){
+    return a.A == b.A && a.X == b.X && a.Y == b.Y && a.SP == b.SP && a.PS == b.PS && a.PC == b.PC &&
+           a.halted == b.halted &&
+           a.cyclesElapsed == b.cyclesElapsed &&
+           a.instructionsRetired == b.instructionsRetired &&
+           memcmp(ma.Data, mb.Data, Mem::MAX_MEM) == 0;
+}
+
+template<class Core>
+static bool check(const char* name, u32 seed, bool selfModify){
+    static Mem liveMem, threadedMem;
+    Core live, threaded;
+    std::mt19937 rng(seed);
+
+    live.reset(CODE_BASE, liveMem);
+    generate<Core>(rng, liveMem, selfModify);
+    for(u32 i=0; i<0x100; i++){
+        liveMem[i] = rng();
+        liveMem[DATA_BASE + i] = rng();
+    }
+
+    threaded.reset(CODE_BASE, threadedMem);
+    memcpy(threadedMem.Data, liveMem.Data, Mem::MAX_MEM);
+
+    ThreadedCode<Core> code;
+    code.analyse(threadedMem, { CODE_BASE });
+    threaded.codeWatch = &code;
+
+    for(u32 q=0; q<2000 && !live.halted; q++){
+        s32 quantum = 1 + rng() % 200;
+        live.exec(quantum, liveMem);
+        code.exec(threaded, threadedMem, quantum);
+
+        if(!same(live, liveMem, threaded, threadedMem)){
+            printf("%s seed %u%s : mismatch after quantum %u at PC 0x%04x / 0x%04x\n",
+                name, seed, selfModify ? " (self-modifying)" : "", q, live.PC, threaded.PC);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(){
+    static constexpr u32 SEEDS = 200;
+    u32 failed = 0;
+
+    for(u32 seed=1; seed<=SEEDS; seed++){
+        failed += !check<CPU>("NMOS", seed, false);
+        failed += !check<CPU>("NMOS", seed, true);
+        failed += !check<BasicCPU<Variant::CMOS_65C02>>("65C02", seed, false);
+        failed += !check<BasicCPU<Variant::CMOS_65C02>>("65C02", seed, true);
+    }
+
+    printf("threaded_check : %u of %u runs differ\n", failed, SEEDS * 4);
+    return failed ? 1 : 0;
+}